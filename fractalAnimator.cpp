@@ -7,6 +7,58 @@
 #include <sstream>
 #include <iomanip>
 #include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cassert>
+#include <new>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <climits>
+#include <cstdio>
+#include <map>
+#include <filesystem>
+#include <zlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRACTAL_SSE2 1
+#endif
+#if defined(__SSSE3__) || (defined(_MSC_VER) && defined(_M_X64))
+#include <tmmintrin.h>
+#define FRACTAL_SSSE3 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRACTAL_NEON 1
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define FRACTAL_IO_URING 1
+#endif
+#endif
 
 // Animation Process
 constexpr const bool animating = true;
@@ -22,11 +74,78 @@ constexpr double ESCAPE_RADIUS_SQUARED = 100.0 * 100.0;
 constexpr double ASPECT_RATIO = static_cast<double>(WINDOW_WIDTH) / WINDOW_HEIGHT;
 
 // Performance settings
-const int NUM_THREADS = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 8;
+int NUM_THREADS = 8; // Set at startup from the CPUs this process may actually use
+std::vector<int> workerCpus; // CPUs render threads are pinned to, empty when pinning is off
+std::vector<int> workerNodes; // NUMA node (dense index) of each entry in workerCpus
+int numNodes = 1;
 constexpr float SCROLL_RENDER_DELAY = 0.1f;
 
+// Tile settings
+constexpr int TILE_SIZE = 64; // 64x64 RGBA tile = 16 KiB, stays resident in L1/L2 while it is filled
+
+// Memory settings
+enum class HugePages { Off, Transparent, Explicit };
+HugePages hugePageMode = HugePages::Off;
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Output settings
+enum class FrameFormat { Png, Qoi, Ppm, Pam, Tga };
+FrameFormat frameFormat = FrameFormat::Png;
+int pngLevel = 6; // zlib compression level of the in-tree PNG writer, 0-9
+constexpr size_t PNG_CHUNK_BYTES = 256 * 1024; // filtered bytes per independently deflated chunk
+enum class FileIo { Blocking, Uring };
+FileIo fileIo = FileIo::Blocking;
+bool directIo = false; // O_DIRECT for frame files written through io_uring
+constexpr int IO_RING_SLOTS = 8; // writes in flight per encoder thread
+constexpr size_t IO_SLOT_BYTES = 1024 * 1024; // registered staging buffer per write
+constexpr double ARCHIVE_COMPACT_FRACTION = 0.25; // closing an archive rewrites it once superseded records are this share of it
+
+// Exponential-map settings
+constexpr int EXPMAP_BAND_ROWS = 64; // log-polar strip rows rendered (and freed) together
+
+// Bump whenever the same RenderState would render differently, so cached frames are re-rendered
+constexpr uint32_t ENGINE_VERSION = 4;
+
 // Anti-aliasing settings
-constexpr int AA_MAX_SAMPLES = 6; // 4x4 = 16 samples per pixel at maximum
+constexpr int AA_MAX_SAMPLES = 6; // 7x7 = 49 samples per pixel at maximum
+constexpr int AA_EDGE_THRESHOLD = 24; // summed RGB curvature across a pixel (or its samples) that marks an edge
+constexpr int AA_PROGRESSIVE_SAMPLES = 64; // interactive anti-aliasing refines the shown frame up to this many samples per pixel
+constexpr int AA_PROGRESSIVE_MIN_SAMPLES = 8;
+constexpr int AA_SETTLED_CHANGE = 2; // a pixel is settled once a pass moves none of its channels by more than this
+constexpr double AA_SETTLED_FRACTION = 0.999; // refinement stops early once a pass leaves this share of pixels settled
+static_assert(AA_MAX_SAMPLES % 2 == 0, "adaptive AA reuses the pixel center, so the sample grid must have one");
+
+// Supersampling settings (animation frames rendered at a multiple of the output size, then filtered down)
+enum class ResampleFilter { Box, Lanczos };
+int supersample = 1;
+ResampleFilter resampleFilter = ResampleFilter::Box;
+constexpr int SUPERSAMPLE_MAX = 8;       // 64 render pixels per output pixel
+constexpr int LANCZOS_LOBES = 3;
+constexpr int RESAMPLE_BAND_ROWS = 32;   // output rows filtered per pool unit
+
+// Histogram coloring settings
+constexpr float HISTOGRAM_CYCLES = 1; // palette cycles spread over a frame's escaped pixels
+constexpr int HISTOGRAM_CHUNK = 1024; // histogram bins merged and prefix-summed per pool unit
+
+#ifndef NDEBUG
+// Debug builds count heap allocations, so the benchmark can check the render loop makes none once warm.
+// Kept out of line: inlined, GCC would see free() called on memory from operator new.
+std::atomic<uint64_t> heapAllocations{ 0 };
+
+[[gnu::noinline]] void* operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* block = std::malloc(size ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+[[gnu::noinline]] void operator delete(void* block, std::size_t) noexcept {
+    std::free(block);
+}
+#endif
 
 // Rendering state
 struct RenderState {
@@ -46,272 +165,4189 @@ struct RenderState {
     float stripeIntensity = 10;
     bool innerCalculation = false;
     bool antiAliasing = false;
+    bool histogramColoring = false; // color by percentile among the frame's escaped pixels instead of colorDensity
+    double aspectRatio = ASPECT_RATIO; // Output width / height, the window's unless rendering headless
 
     // Helper to get the viewport width based on aspect ratio
     double getViewportWidth() const {
-        return viewportHeight * ASPECT_RATIO;
+        return viewportHeight * aspectRatio;
+    }
+};
+
+// Rectangular block of pixels, the unit of work handed to render threads
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+// A tile (or part of one) scheduled for rendering, with its predicted and measured iteration cost
+struct WorkUnit {
+    Tile tile;
+    int cell;                // index of the TILE_SIZE grid cell that contains it
+    double predictedCost;
+    uint64_t actualCost;
+    int order;               // position in the plan before sorting, so equal costs keep the curve order
+};
+
+// Per-pixel iteration cost of the last rendered frame on the TILE_SIZE grid
+struct CostMap {
+    RenderState state;
+    int width = 0, height = 0;
+    int tilesX = 0, tilesY = 0;
+    std::vector<double> pixelCost;
+    double meanPixelCost = 0;
+    bool valid = false;
+};
+
+// Zoom animation description. Every parameter moves 1/easing of the remaining distance to its
+// target each frame, so frame N's state follows in closed form without replaying frames 0..N-1.
+struct ZoomAnimation {
+    RenderState start;
+    double targetX = -1.7110287606470104826428269;
+    double targetY = 0.0003109297379698081368812;
+    double targetHeight = 0.0000000000001705302565824;
+    double targetColorDensity = 0.0186927672475576400756836;
+    int targetIterations = 1941;
+    int positionEasing = 1;
+    int easing = 25;
+
+    RenderState stateAt(int frameNumber) const {
+        RenderState state = start;
+        double positionLeft = std::pow(1.0 - 1.0 / positionEasing, frameNumber);
+        double left = std::pow(1.0 - 1.0 / easing, frameNumber);
+
+        state.viewportX = targetX + (start.viewportX - targetX) * positionLeft;
+        state.viewportY = targetY + (start.viewportY - targetY) * positionLeft;
+        state.viewportHeight = targetHeight + (start.viewportHeight - targetHeight) * left;
+        state.colorDensity = static_cast<float>(targetColorDensity + (start.colorDensity - targetColorDensity) * left);
+
+        // Iterations step by integer division, which stalls once within `easing` of the target.
+        // Replay that exactly; it reaches its fixed point after a few hundred steps at most.
+        for (int i = 0; i < frameNumber; i++) {
+            int step = (targetIterations - state.maxIterations) / easing;
+            if (step == 0) break;
+            state.maxIterations += step;
+        }
+        return state;
+    }
+};
+
+struct ReturnInfo {
+    int iteration;
+    double smoothIteration;
+    double stripeSum;
+    int cost; // iterations actually run; 1 for a point the cardioid or bulb check settles at once
+};
+
+// Flags of a packed iteration result
+enum ResultFlags : uint8_t {
+    RESULT_INTERIOR = 1,   // did not escape within the iteration limit
+    RESULT_GLITCHED = 2,   // reserved for perturbation rendering: the reference orbit was unusable here
+    RESULT_UNFINISHED = 4, // reserved for continuing iteration past the limit in a later pass
+};
+
+// An iteration result as retained and shaded: the smooth iteration count as float, the stripe average
+// (stripeSum / iteration, in [0, 1]) as 16-bit fixed point, and flags
+struct PackedResult {
+    float smooth;
+    uint16_t stripe;
+    uint8_t flags;
+};
+
+// The results of one TILE_SIZE grid cell, structure-of-arrays with rows TILE_SIZE apart: 7 bytes a
+// pixel instead of ReturnInfo's 32. A frame's results are its cells in row-major order.
+struct ResultCell {
+    float smooth[TILE_SIZE * TILE_SIZE];
+    uint16_t stripe[TILE_SIZE * TILE_SIZE];
+    uint8_t flags[TILE_SIZE * TILE_SIZE];
+};
+
+inline size_t resultBufferBytes(int width, int height) {
+    return static_cast<size_t>((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE) * sizeof(ResultCell);
+}
+
+// The cell of a frame's results holding pixel (x, y), and the pixel's index within its cell
+inline ResultCell& resultCell(ResultCell* results, int width, int x, int y) {
+    return results[(y / TILE_SIZE) * ((width + TILE_SIZE - 1) / TILE_SIZE) + x / TILE_SIZE];
+}
+
+inline int cellIndex(int x, int y) {
+    return (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+}
+
+inline PackedResult packResult(const ReturnInfo& info) {
+    if (info.iteration == -1) return { 0, 0, RESULT_INTERIOR };
+    double average = info.iteration > 0 ? info.stripeSum / info.iteration : 0;
+    return { static_cast<float>(info.smoothIteration),
+        static_cast<uint16_t>(std::min(std::max(average, 0.0), 1.0) * 65535 + 0.5), 0 };
+}
+
+inline float stripeAverage(uint16_t stripe) {
+    return stripe * (1.0f / 65535);
+}
+
+// Forward declarations
+struct FrameInFlight;
+void submitShading(FrameInFlight& frameJob, const FrameInFlight& source);
+void equalizeColors(FrameInFlight& frameJob);
+uint64_t renderFractalTile(sf::Uint8* pixels, ResultCell* results, const RenderState& state, const Tile& tile, int width, int height, sf::Uint8* tileBuffer);
+void saveScreenshot(const sf::Texture& texture, const RenderState& state);
+std::string getInfoString(const RenderState& state, double mouseX, double mouseY);
+
+// Color palettes
+const std::vector<std::vector<sf::Color>> PALETTES = {
+    {
+        sf::Color(66, 30, 15), sf::Color(25, 7, 26), sf::Color(9, 1, 47),
+        sf::Color(4, 4, 73), sf::Color(0, 7, 100), sf::Color(12, 44, 138),
+        sf::Color(24, 82, 177), sf::Color(57, 125, 209), sf::Color(134, 181, 229),
+        sf::Color(211, 236, 248), sf::Color(241, 233, 191), sf::Color(248, 201, 95),
+        sf::Color(255, 170, 0), sf::Color(204, 128, 0), sf::Color(153, 87, 0),
+    },
+    {
+        sf::Color(0, 0, 0), sf::Color(255, 255, 255),
+    }
+};
+
+// Linear interpolation for colors
+inline sf::Color interpolateColors(const sf::Color& c1, const sf::Color& c2, double factor) {
+    return sf::Color(
+        static_cast<sf::Uint8>(c1.r + factor * (c2.r - c1.r)),
+        static_cast<sf::Uint8>(c1.g + factor * (c2.g - c1.g)),
+        static_cast<sf::Uint8>(c1.b + factor * (c2.b - c1.b))
+    );
+}
+
+// Colors as four RGBA bytes in one word, in memory order
+inline uint32_t packColor(const sf::Color& color) {
+    const sf::Uint8 bytes[4] = { color.r, color.g, color.b, color.a };
+    uint32_t packed;
+    std::memcpy(&packed, bytes, 4);
+    return packed;
+}
+
+inline sf::Color unpackColor(uint32_t packed) {
+    sf::Uint8 bytes[4];
+    std::memcpy(bytes, &packed, 4);
+    return sf::Color(bytes[0], bytes[1], bytes[2], bytes[3]);
+}
+
+// Palettes as dense gradient tables: PALETTE_LUT_SIZE packed colors sampled evenly over one cycle of the
+// palette, so a palette position is shaded with a multiply and a lookup instead of a modulo and an
+// interpolation. Entries are at most one level per channel off the exact interpolation.
+constexpr int PALETTE_LUT_SIZE = 4096; // power of two, so positions wrap with a mask
+
+struct PaletteLut {
+    int size;     // palette entries
+    double scale; // table entries per palette entry
+    std::vector<uint32_t> colors;
+};
+
+const std::vector<PaletteLut> PALETTE_LUTS = [] {
+    std::vector<PaletteLut> luts;
+    for (const auto& palette : PALETTES) {
+        PaletteLut lut;
+        lut.size = static_cast<int>(palette.size());
+        lut.scale = static_cast<double>(PALETTE_LUT_SIZE) / palette.size();
+        lut.colors.resize(PALETTE_LUT_SIZE);
+        for (int i = 0; i < PALETTE_LUT_SIZE; i++) {
+            double position = static_cast<double>(i) * palette.size() / PALETTE_LUT_SIZE;
+            size_t index = static_cast<size_t>(position);
+            lut.colors[i] = packColor(interpolateColors(palette[index], palette[(index + 1) % palette.size()], position - index));
+        }
+        luts.push_back(std::move(lut));
+    }
+    return luts;
+}();
+
+// Color at a palette position (counted in palette entries, wrapping) from its gradient table.
+// The vector shading kernel computes the same table entry for positions in its range.
+inline sf::Color lutColor(const PaletteLut& palette, float iterations) {
+    double position = iterations * palette.scale;
+    int64_t entry = 0;
+    if (std::fabs(position) < 9e18) { // NaN and positions too large to convert use the first entry
+        entry = static_cast<int64_t>(position);
+        entry -= position < entry;
+    }
+    return unpackColor(palette.colors[entry & (PALETTE_LUT_SIZE - 1)]);
+}
+
+// Fast calculation of fractal iteration count with optimizations
+inline ReturnInfo calculateFractal(double cr, double ci, double jr, double ji, int maxIter, bool isJulia, int fractalType, bool stripes, float stripeFrequency, bool innerCalculation) {
+    // Set initial values based on fractal type
+    double zr = isJulia ? cr : 0;
+    double zi = isJulia ? ci : 0;
+    double cr_actual = isJulia ? jr : cr;
+    double ci_actual = isJulia ? ji : ci;
+
+    ReturnInfo iterationInfo;
+
+    // Early bailout checks for Mandelbrot
+    if (!innerCalculation && !isJulia && fractalType == 0) {
+        // Cardioid check
+        double q = (cr - 0.25) * (cr - 0.25) + ci * ci;
+        if (q * (q + (cr - 0.25)) < 0.25 * ci * ci) {
+            iterationInfo.iteration = -1;
+            iterationInfo.cost = 1;
+            return iterationInfo;
+        }
+
+        // Period-2 bulb check
+        if ((cr + 1.0) * (cr + 1.0) + ci * ci < 0.0625) {
+            iterationInfo.iteration = -1;
+            iterationInfo.cost = 1;
+            return iterationInfo;
+        }
+    }
+
+    double zr2 = zr * zr;
+    double zi2 = zi * zi;
+    float stripeSum = 0;
+    int i = 0;
+
+    // Main iteration loop (optimized)
+    while (zr2 + zi2 < ESCAPE_RADIUS_SQUARED) {
+        zi = (fractalType == 0) ? 2 * zr * zi : 2 * fabs(zr * zi);
+        zi += ci_actual;
+        zr = zr2 - zi2 + cr_actual;
+        zr2 = zr * zr;
+        zi2 = zi * zi;
+        if (stripes) stripeSum += powf(sin(atan2(zi, zr) * stripeFrequency), 2.0);
+        i++;
+        if (i == maxIter) {
+            iterationInfo.cost = i;
+            if (innerCalculation) {
+                iterationInfo.iteration = i;
+                iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
+                iterationInfo.stripeSum = stripeSum;
+                return iterationInfo;
+            }
+            else {
+                iterationInfo.iteration = -1;
+                return iterationInfo;
+            }
+        }
+    }
+
+    // Smooth coloring formula
+    iterationInfo.iteration = i;
+    iterationInfo.cost = std::max(i, 1);
+    iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
+    iterationInfo.stripeSum = stripeSum;
+    return iterationInfo;
+}
+
+// True if the frame is colored by histogram: needs the whole frame's results before any pixel is shaded
+inline bool equalizedColors(const RenderState& state) {
+    return state.histogramColoring && !state.stripes && !state.antiAliasing;
+}
+
+// Histogram bin of an escaped pixel: its smooth iteration count, clamped to 0..maxIterations
+inline int histogramBin(double smooth, int maxIterations) {
+    if (!(smooth > 0)) return 0;
+    return smooth < maxIterations ? static_cast<int>(smooth) : maxIterations;
+}
+
+// Palette position under histogram coloring. levels[k] is the fraction of the frame's escaped pixels in
+// bins below k (maxIterations + 2 of them); positions between whole counts are interpolated.
+inline float equalizedPosition(const float* levels, double smooth, int maxIterations, const PaletteLut& palette) {
+    int bin = histogramBin(smooth, maxIterations);
+    double fract = std::min(std::max(smooth - bin, 0.0), 1.0);
+    double percentile = levels[bin] + fract * (levels[bin + 1] - levels[bin]);
+    return static_cast<float>(percentile * HISTOGRAM_CYCLES * palette.size);
+}
+
+// Color of one iteration result; the only part of a render that colorScheme, colorDensity, stripeIntensity
+// and histogramColoring affect. `levels` are the frame's histogram levels when it is colored by histogram.
+inline sf::Color shadePixel(const PackedResult& result, const RenderState& state, const PaletteLut& palette, const float* levels = nullptr) {
+    if (result.flags & RESULT_INTERIOR) {
+        return sf::Color(0, 0, 0);
+    }
+
+    float iterations;
+    if (state.stripes) {
+        iterations = state.stripeIntensity * stripeAverage(result.stripe);
+    }
+    else if (levels) {
+        iterations = equalizedPosition(levels, result.smooth, state.maxIterations, palette);
+    }
+    else {
+        iterations = result.smooth * state.colorDensity;
+    }
+    return lutColor(palette, iterations);
+}
+
+// Color of the fractal at a subpixel position (x, y in pixels, the pixel's top left corner at whole numbers)
+inline sf::Color sampleColorAt(double x, double y, const RenderState& state, int width, int height,
+    const PaletteLut& palette, bool& interior, uint64_t& cost, const float* levels = nullptr) {
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double halfHeight = state.viewportHeight / 2;
+    double halfWidth = state.getViewportWidth() / 2;
+    double cr = state.viewportX - halfWidth + x * pixelWidth;
+    double ci = state.viewportY - halfHeight + y * pixelHeight;
+
+    ReturnInfo info = calculateFractal(cr, ci, state.juliaX, state.juliaY,
+        state.maxIterations, state.showJulia, state.fractalType, state.stripes,
+        state.stripeFrequency, state.innerCalculation);
+    cost += info.cost;
+    PackedResult result = packResult(info);
+    interior = result.flags & RESULT_INTERIOR;
+    return shadePixel(result, state, palette, levels);
+}
+
+// Color of sample (sx, sy) of a pixel's (AA_MAX_SAMPLES + 1)^2 anti-aliasing grid
+inline sf::Color sampleColor(int x, int y, int sx, int sy, const RenderState& state, int width, int height,
+    const PaletteLut& palette, bool& interior, uint64_t& cost) {
+    int samples = AA_MAX_SAMPLES + 1;
+    double offsetX = (sx + 0.5) / samples;
+    double offsetY = (sy + 0.5) / samples;
+    return sampleColorAt(x + offsetX, y + offsetY, state, width, height, palette, interior, cost);
+}
+
+// How far a color is from lying halfway between two others (summed over RGB). Zero on a linear
+// gradient, which supersampling would only average back to its center, large across an edge or a band
+inline int colorCurvature(sf::Color a, sf::Color center, sf::Color b) {
+    return std::abs(a.r + b.r - 2 * center.r) + std::abs(a.g + b.g - 2 * center.g) + std::abs(a.b + b.b - 2 * center.b);
+}
+
+// True if a pixel breaks from its 3x3 neighborhood: an interior boundary runs through it, or it is not on
+// a linear gradient with its neighbors in some direction. `i` indexes samples `stride` to a row.
+inline bool isEdgePixel(const sf::Color* colors, const bool* interior, int i, int stride) {
+    bool edge = false;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            edge = edge || interior[i + dy * stride + dx] != interior[i];
+        }
+    }
+    const int directions[4] = { 1, stride, stride + 1, stride - 1 };
+    for (int d : directions) {
+        edge = edge || colorCurvature(colors[i - d], colors[i], colors[i + d]) > AA_EDGE_THRESHOLD;
+    }
+    return edge;
+}
+
+// Supersample a pixel on an edge, progressively: the grid's corners and edge midpoints around the
+// (already sampled) center first, and the rest of the grid only if those nine are not a plain gradient
+sf::Color supersamplePixel(int x, int y, sf::Color center, bool centerInterior, const RenderState& state,
+    int width, int height, const PaletteLut& palette, uint64_t& cost) {
+    const int samples = AA_MAX_SAMPLES + 1;
+    const int step = AA_MAX_SAMPLES / 2;
+    int totalR = center.r, totalG = center.g, totalB = center.b;
+    bool mixed = false;
+
+    sf::Color ring[3][3];
+    for (int sy = 0; sy < samples; sy += step) {
+        for (int sx = 0; sx < samples; sx += step) {
+            if (sx == step && sy == step) continue;
+            bool interior;
+            sf::Color color = sampleColor(x, y, sx, sy, state, width, height, palette, interior, cost);
+            ring[sy / step][sx / step] = color;
+            totalR += color.r;
+            totalG += color.g;
+            totalB += color.b;
+            mixed = mixed || interior != centerInterior;
+        }
+    }
+    int curvature = std::max(std::max(colorCurvature(ring[0][0], center, ring[2][2]), colorCurvature(ring[0][1], center, ring[2][1])),
+        std::max(colorCurvature(ring[0][2], center, ring[2][0]), colorCurvature(ring[1][0], center, ring[1][2])));
+    if (!mixed && curvature <= AA_EDGE_THRESHOLD) {
+        return sf::Color(static_cast<sf::Uint8>(totalR / 9), static_cast<sf::Uint8>(totalG / 9), static_cast<sf::Uint8>(totalB / 9));
+    }
+
+    for (int sy = 0; sy < samples; sy++) {
+        for (int sx = 0; sx < samples; sx++) {
+            if (sx % step == 0 && sy % step == 0) continue;
+            bool interior;
+            sf::Color color = sampleColor(x, y, sx, sy, state, width, height, palette, interior, cost);
+            totalR += color.r;
+            totalG += color.g;
+            totalB += color.b;
+        }
+    }
+
+    // Average the samples
+    int sampleCount = samples * samples;
+    return sf::Color(
+        static_cast<sf::Uint8>(totalR / sampleCount),
+        static_cast<sf::Uint8>(totalG / sampleCount),
+        static_cast<sf::Uint8>(totalB / sampleCount)
+    );
+}
+
+// Read a whole small file (sysfs/cgroupfs), empty if it does not exist
+std::string readSmallFile(const std::string& path) {
+    std::ifstream file(path);
+    std::string contents;
+    std::getline(file, contents);
+    return contents;
+}
+
+// CPUs in this process's affinity mask, or empty where that is not available
+std::vector<int> getAllowedCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+// Keep only the first hardware thread of every physical core
+std::vector<int> skipSmtSiblings(const std::vector<int>& cpus) {
+    std::vector<int> cores;
+    for (int cpu : cpus) {
+        // thread_siblings_list looks like "0,64" or "0-1"; its first number is the core's primary thread
+        std::string siblings = readSmallFile("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+        if (siblings.empty() || std::atoi(siblings.c_str()) == cpu) {
+            cores.push_back(cpu);
+        }
+    }
+    return cores.empty() ? cpus : cores;
+}
+
+// CPU limit from the cgroup quotas (v2 cpu.max, v1 cfs_quota_us), rounded up; 0 when unlimited.
+// The process's own cgroups come from /proc/self/cgroup, and every cgroup from there up to the root of
+// its hierarchy can cap it, so the tightest quota on the way up wins. Levels whose files are not visible
+// (above a container's cgroup namespace) are skipped.
+int getCgroupCpuLimit() {
+    double limit = 0; // in CPUs, 0 until some level has a quota
+    auto addQuota = [&](double quota, double period) {
+        if (quota > 0 && period > 0 && (limit == 0 || quota / period < limit)) limit = quota / period;
+    };
+
+    std::ifstream cgroups("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(cgroups, line)) {
+        // "hierarchy:controllers:path"; the v2 hierarchy lists no controllers
+        size_t first = line.find(':');
+        size_t second = first == std::string::npos ? first : line.find(':', first + 1);
+        if (second == std::string::npos) continue;
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+        if (path == "/") path.clear();
+
+        bool v2 = controllers.empty();
+        std::vector<std::string> mounts;
+        if (v2) {
+            mounts.push_back("/sys/fs/cgroup");
+        }
+        else {
+            std::istringstream names(controllers);
+            std::string name;
+            bool cpu = false;
+            while (std::getline(names, name, ',')) cpu = cpu || name == "cpu";
+            if (!cpu) continue;
+            mounts.push_back("/sys/fs/cgroup/" + controllers);
+            if (controllers != "cpu") mounts.push_back("/sys/fs/cgroup/cpu");
+        }
+
+        for (const std::string& mount : mounts) {
+            for (std::string level = path;; level.erase(level.rfind('/'))) {
+                std::string dir = mount + level + "/";
+                if (v2) {
+                    std::istringstream fields(readSmallFile(dir + "cpu.max"));
+                    std::string quotaField;
+                    double period = 0;
+                    if (fields >> quotaField >> period && quotaField != "max") addQuota(std::atof(quotaField.c_str()), period);
+                }
+                else {
+                    std::string quotaText = readSmallFile(dir + "cpu.cfs_quota_us");
+                    if (!quotaText.empty()) {
+                        addQuota(std::atof(quotaText.c_str()), std::atof(readSmallFile(dir + "cpu.cfs_period_us").c_str()));
+                    }
+                }
+                if (level.empty()) break;
+            }
+        }
+    }
+
+    if (limit <= 0) return 0;
+    return std::max(1, static_cast<int>(std::ceil(limit)));
+}
+
+// Number of render threads the container and affinity mask really allow
+int detectThreadCount(const std::vector<int>& cpus) {
+    int count = !cpus.empty() ? static_cast<int>(cpus.size()) : static_cast<int>(std::thread::hardware_concurrency());
+    if (count <= 0) count = 8;
+
+    int cgroupLimit = getCgroupCpuLimit();
+    if (cgroupLimit > 0) count = std::min(count, cgroupLimit);
+    return count;
+}
+
+// Parse a kernel CPU list such as "0-3,8,10-11"
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// NUMA node of every CPU (indexed by CPU number, -1 when unknown)
+std::vector<int> readCpuNodes() {
+    std::vector<int> cpuNodes;
+    for (int node = 0; node < 64; node++) {
+        std::string cpuList = readSmallFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        for (int cpu : parseCpuList(cpuList)) {
+            if (cpu >= static_cast<int>(cpuNodes.size())) cpuNodes.resize(cpu + 1, -1);
+            cpuNodes[cpu] = node;
+        }
+    }
+    return cpuNodes;
+}
+
+// Pin the calling render thread to its CPU when pinning is enabled. Threads pin themselves before
+// claiming any work, so every page they first-touch is placed on their own node.
+void pinCurrentThread(int index) {
+#ifdef __linux__
+    if (workerCpus.empty()) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(workerCpus[index % workerCpus.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+// A batch of independent work units (a frame, or a pass over one) for the render pool.
+// Units are queued per NUMA node; a thread drains its own node's queue in order before helping the others.
+// A job is reused from frame to frame, so its queues keep their capacity; `work` should capture at most
+// two references, which std::function stores without a heap allocation.
+struct RenderJob {
+    std::vector<std::vector<int>> queues;
+    std::vector<int> nextInQueue;   // guarded by the pool mutex
+    int unclaimed = 0;              // guarded by the pool mutex
+    std::atomic<int> remaining{ 0 };
+    std::function<void(int unit, int thread)> work;
+    bool finished = true;
+
+    // Room for up to `units` units on any one node, so submitting never grows the queues
+    void reserve(int units) {
+        queues.resize(numNodes);
+        for (std::vector<int>& queue : queues) queue.reserve(units);
+    }
+};
+
+// Persistent (optionally pinned) render threads shared by every frame in flight.
+// Jobs are served oldest first, so threads only spill into a newer frame once the older one is fully claimed.
+class RenderPool {
+public:
+    ~RenderPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Urgent jobs (ones a caller is about to wait on) go ahead of the frames already queued
+    template <typename NodeOf>
+    void submit(RenderJob& job, int unitCount, NodeOf nodeOf, std::function<void(int, int)> work, bool urgent = false) {
+        if (threads.empty()) start();
+
+        job.queues.resize(numNodes);
+        for (std::vector<int>& queue : job.queues) queue.clear();
+        for (int i = 0; i < unitCount; i++) {
+            job.queues[nodeOf(i)].push_back(i);
+        }
+        job.nextInQueue.assign(numNodes, 0);
+        job.unclaimed = unitCount;
+        job.remaining = unitCount;
+        job.work = std::move(work);
+        job.finished = unitCount == 0;
+        if (job.finished) return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (urgent) jobs.insert(jobs.begin(), &job);
+            else jobs.push_back(&job);
+        }
+        workAvailable.notify_all();
+    }
+
+    void wait(RenderJob& job) {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobFinished.wait(lock, [&]() { return job.finished; });
+    }
+
+    // Poll a job without blocking
+    bool isFinished(RenderJob& job) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return job.finished;
+    }
+
+private:
+    void start() {
+        for (int i = 0; i < NUM_THREADS; i++) {
+            threads.emplace_back(&RenderPool::workerLoop, this, i);
+        }
+    }
+
+    // Claim the next unit of a job (called with the mutex held), preferring this thread's NUMA node
+    int claimUnit(RenderJob& job, int home) {
+        for (int k = 0; k < numNodes; k++) {
+            int node = (home + k) % numNodes;
+            if (job.nextInQueue[node] < static_cast<int>(job.queues[node].size())) {
+                job.unclaimed--;
+                return job.queues[node][job.nextInQueue[node]++];
+            }
+        }
+        return -1;
+    }
+
+    void workerLoop(int threadIndex) {
+        pinCurrentThread(threadIndex);
+        int home = workerNodes.empty() ? 0 : workerNodes[threadIndex % workerNodes.size()];
+        while (true) {
+            RenderJob* job;
+            int unit;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workAvailable.wait(lock, [&]() { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = jobs.front();
+                unit = claimUnit(*job, home);
+
+                // Fully claimed jobs leave the queue at once, so the next frame gets the idle threads
+                if (job->unclaimed == 0) jobs.erase(jobs.begin());
+            }
+
+            job->work(unit, threadIndex);
+            if (--job->remaining == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                job->finished = true;
+                jobFinished.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<RenderJob*> jobs; // a handful at a time; unlike a deque, never frees and refills blocks
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable jobFinished;
+    bool stopping = false;
+};
+
+RenderPool renderPool;
+
+// NUMA node that owns a tile: the frame is split into one horizontal band per node
+inline int tileNode(const Tile& tile, int height) {
+    return std::min(numNodes - 1, tile.y0 * numNodes / height);
+}
+
+// Allocate a large buffer without touching it, optionally backed by huge pages.
+// Pages land on the NUMA node of whichever thread writes them first.
+sf::Uint8* allocateLargeBuffer(size_t bytes) {
+#ifdef __linux__
+    size_t length = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void* buffer = MAP_FAILED;
+    if (hugePageMode == HugePages::Explicit) {
+        buffer = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (buffer == MAP_FAILED) {
+            std::cerr << "No explicit huge pages available, falling back to transparent huge pages" << std::endl;
+        }
+    }
+    if (buffer == MAP_FAILED) {
+        buffer = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) throw std::bad_alloc();
+        if (hugePageMode != HugePages::Off) madvise(buffer, length, MADV_HUGEPAGE);
+    }
+    return static_cast<sf::Uint8*>(buffer);
+#else
+    return new sf::Uint8[bytes];
+#endif
+}
+
+void freeLargeBuffer(sf::Uint8* buffer, size_t bytes) {
+#ifdef __linux__
+    munmap(buffer, (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+#else
+    delete[] buffer;
+#endif
+}
+
+// Distance along a Hilbert curve covering an n x n grid (n must be a power of two)
+inline uint32_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y) {
+    uint32_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so the curve stays continuous
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// Split the frame into tiles ordered along a Hilbert curve, so consecutive tiles are spatial neighbours
+std::vector<Tile> buildTiles(int width, int height) {
+    int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    uint32_t curveSize = 1;
+    while (curveSize < static_cast<uint32_t>(std::max(tilesX, tilesY))) curveSize *= 2;
+
+    std::vector<std::pair<uint32_t, Tile>> ordered;
+    ordered.reserve(tilesX * tilesY);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            Tile tile;
+            tile.x0 = tx * TILE_SIZE;
+            tile.y0 = ty * TILE_SIZE;
+            tile.x1 = std::min(width, tile.x0 + TILE_SIZE);
+            tile.y1 = std::min(height, tile.y0 + TILE_SIZE);
+            ordered.emplace_back(hilbertIndex(curveSize, tx, ty), tile);
+        }
+    }
+    std::sort(ordered.begin(), ordered.end(),
+        [](const std::pair<uint32_t, Tile>& a, const std::pair<uint32_t, Tile>& b) { return a.first < b.first; });
+
+    std::vector<Tile> tiles;
+    tiles.reserve(ordered.size());
+    for (const auto& entry : ordered) {
+        tiles.push_back(entry.second);
+    }
+    return tiles;
+}
+
+// Tile list for the given frame size, rebuilt only when the size changes
+const std::vector<Tile>& getTiles(int width, int height) {
+    static std::vector<Tile> tiles;
+    static int tilesWidth = 0, tilesHeight = 0;
+    if (width != tilesWidth || height != tilesHeight) {
+        tiles = buildTiles(width, height);
+        tilesWidth = width;
+        tilesHeight = height;
+    }
+    return tiles;
+}
+
+// Cost measured on the previous frame, used to plan the next one
+CostMap previousFrameCost;
+
+// Predict the iteration cost of a rectangle by warping sample points into the previous frame
+double predictCost(const CostMap& costs, const RenderState& state, const Tile& rect, int width, int height) {
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double left = state.viewportX - state.getViewportWidth() / 2;
+    double top = state.viewportY - state.viewportHeight / 2;
+
+    double prevPixelHeight = costs.state.viewportHeight / costs.height;
+    double prevPixelWidth = costs.state.getViewportWidth() / costs.width;
+    double prevLeft = costs.state.viewportX - costs.state.getViewportWidth() / 2;
+    double prevTop = costs.state.viewportY - costs.state.viewportHeight / 2;
+
+    // Average the cost density at a 2x2 grid of points inside the rectangle
+    double density = 0;
+    for (int sy = 0; sy < 2; sy++) {
+        for (int sx = 0; sx < 2; sx++) {
+            double px = rect.x0 + (rect.x1 - rect.x0) * (sx * 2 + 1) / 4.0;
+            double py = rect.y0 + (rect.y1 - rect.y0) * (sy * 2 + 1) / 4.0;
+            double prevX = (left + px * pixelWidth - prevLeft) / prevPixelWidth;
+            double prevY = (top + py * pixelHeight - prevTop) / prevPixelHeight;
+
+            if (prevX < 0 || prevY < 0 || prevX >= costs.width || prevY >= costs.height) {
+                density += costs.meanPixelCost; // Not visible last frame
+            }
+            else {
+                int cell = static_cast<int>(prevY) / TILE_SIZE * costs.tilesX + static_cast<int>(prevX) / TILE_SIZE;
+                density += costs.pixelCost[cell];
+            }
+        }
+    }
+    return density / 4 * (rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+}
+
+// Split the frame into work units sized and ordered by predicted cost, most expensive first.
+// `units` is refilled in place; it is reserved for every tile quartered twice, so it never grows again.
+void planWorkUnits(const RenderState& state, int width, int height, std::vector<WorkUnit>& units) {
+    const std::vector<Tile>& tiles = getTiles(width, height);
+    int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+
+    units.clear();
+    units.reserve(tiles.size() * 16);
+    for (const Tile& tile : tiles) {
+        WorkUnit unit;
+        unit.tile = tile;
+        unit.cell = tile.y0 / TILE_SIZE * tilesX + tile.x0 / TILE_SIZE;
+        unit.predictedCost = 0;
+        unit.actualCost = 0;
+        unit.order = 0;
+        units.push_back(unit);
+    }
+
+    // Without a previous frame, keep the curve order
+    if (!previousFrameCost.valid) return;
+
+    double totalCost = 0;
+    for (WorkUnit& unit : units) {
+        unit.predictedCost = predictCost(previousFrameCost, state, unit.tile, width, height);
+        totalCost += unit.predictedCost;
+    }
+
+    // Quarter any unit that would leave a long tail, down to a quarter of a tile
+    double budget = totalCost / (NUM_THREADS * 4);
+    for (size_t i = 0; i < units.size(); i++) {
+        Tile tile = units[i].tile;
+        if (units[i].predictedCost <= budget || tile.x1 - tile.x0 <= TILE_SIZE / 4 || tile.y1 - tile.y0 <= TILE_SIZE / 4) {
+            continue;
+        }
+
+        int midX = (tile.x0 + tile.x1) / 2;
+        int midY = (tile.y0 + tile.y1) / 2;
+        Tile quarters[4] = {
+            { tile.x0, tile.y0, midX, midY }, { midX, tile.y0, tile.x1, midY },
+            { tile.x0, midY, midX, tile.y1 }, { midX, midY, tile.x1, tile.y1 },
+        };
+        int cell = units[i].cell;
+        for (int q = 0; q < 4; q++) {
+            WorkUnit part;
+            part.tile = quarters[q];
+            part.cell = cell;
+            part.predictedCost = predictCost(previousFrameCost, state, quarters[q], width, height);
+            part.actualCost = 0;
+            part.order = 0;
+            if (q == 0) units[i] = part;
+            else units.push_back(part);
+        }
+        i--; // Re-check the first quarter
+    }
+
+    // A stable sort would take a temporary buffer from the heap; breaking ties by position is equivalent
+    for (size_t i = 0; i < units.size(); i++) units[i].order = static_cast<int>(i);
+    std::sort(units.begin(), units.end(), [](const WorkUnit& a, const WorkUnit& b) {
+        return a.predictedCost > b.predictedCost || (a.predictedCost == b.predictedCost && a.order < b.order);
+    });
+}
+
+// Fold the measured unit costs back onto the tile grid for the next frame's prediction
+void recordFrameCost(const std::vector<WorkUnit>& units, const RenderState& state, int width, int height) {
+    CostMap& costs = previousFrameCost;
+    costs.state = state;
+    costs.width = width;
+    costs.height = height;
+    costs.tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    costs.tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    costs.pixelCost.assign(costs.tilesX * costs.tilesY, 0.0);
+
+    double totalCost = 0;
+    for (const WorkUnit& unit : units) {
+        costs.pixelCost[unit.cell] += unit.actualCost;
+        totalCost += unit.actualCost;
+    }
+    for (int cell = 0; cell < costs.tilesX * costs.tilesY; cell++) {
+        int x0 = cell % costs.tilesX * TILE_SIZE;
+        int y0 = cell / costs.tilesX * TILE_SIZE;
+        int cellPixels = (std::min(width, x0 + TILE_SIZE) - x0) * (std::min(height, y0 + TILE_SIZE) - y0);
+        costs.pixelCost[cell] /= cellPixels;
+    }
+    costs.meanPixelCost = totalCost / (static_cast<double>(width) * height);
+    costs.valid = true;
+}
+
+// A frame handed to the render pool, possibly while other frames are still in flight
+struct FrameInFlight {
+    RenderState state;
+    sf::Uint8* pixels = nullptr;
+    sf::Uint8* output = nullptr;   // the frame at output size: pixels, or what a supersampled render is filtered into
+    ResultCell* results = nullptr; // optional iteration results, kept for re-shading
+    bool hasResults = false;       // results hold this frame's iterations
+    std::vector<uint32_t> histograms; // per-thread smooth iteration counts, for histogram coloring
+    std::vector<float> levels;        // histogram levels of the results, empty until counted
+    std::vector<uint64_t> chunkStarts; // escaped pixels before each chunk of histogram bins
+    int width = 0, height = 0;
+    std::vector<WorkUnit> units;
+    const std::vector<Tile>* tiles = nullptr; // tiles of a pass over the whole frame (shading, counting)
+    RenderJob job;
+};
+
+// Plan a frame and queue its units on the pool without waiting for them
+void submitFrame(FrameInFlight& frameJob) {
+    planWorkUnits(frameJob.state, frameJob.width, frameJob.height, frameJob.units);
+    frameJob.job.reserve(static_cast<int>(frameJob.units.capacity()));
+    frameJob.hasResults = frameJob.results && !frameJob.state.antiAliasing;
+    frameJob.levels.clear();
+
+    // Threads pull units from the front of the plan, so expensive work starts first
+    renderPool.submit(frameJob.job, static_cast<int>(frameJob.units.size()),
+        [&](int i) { return tileNode(frameJob.units[i].tile, frameJob.height); },
+        [&frameJob](int i, int) {
+            thread_local sf::Uint8 tileBuffer[TILE_SIZE * TILE_SIZE * 4];
+            WorkUnit& unit = frameJob.units[i];
+            unit.actualCost = renderFractalTile(frameJob.pixels, frameJob.results, frameJob.state, unit.tile,
+                frameJob.width, frameJob.height, tileBuffer);
+        });
+}
+
+// Wait for a submitted frame and feed its measured cost to the scheduler. A frame colored by
+// histogram is only iterated by then; it is shaded here once its histogram is known.
+void finishFrame(FrameInFlight& frameJob) {
+    renderPool.wait(frameJob.job);
+    if (frameJob.units.empty()) return; // not rendered tile by tile, nothing to learn from
+    recordFrameCost(frameJob.units, frameJob.state, frameJob.width, frameJob.height);
+    if (frameJob.hasResults && equalizedColors(frameJob.state)) {
+        if (frameJob.levels.empty()) equalizeColors(frameJob);
+        submitShading(frameJob, frameJob);
+        renderPool.wait(frameJob.job);
+    }
+}
+
+// Render the fractal using multiple threads, keeping the iteration results in `results` if given.
+// The frame and its buffers are kept between calls, so rendering the same size again allocates nothing.
+void renderFractal(sf::Uint8* pixels, const RenderState& state, int width, int height, bool usePreview = false, ResultCell* results = nullptr) {
+    static std::vector<ResultCell> ownResults; // histogram coloring shades from the whole frame's results
+    if (!results && equalizedColors(state)) {
+        size_t cells = resultBufferBytes(width, height) / sizeof(ResultCell);
+        if (ownResults.size() < cells) ownResults.resize(cells);
+        results = ownResults.data();
+    }
+    static FrameInFlight frameJob;
+    frameJob.state = state;
+    frameJob.pixels = pixels;
+    frameJob.results = results;
+    frameJob.width = width;
+    frameJob.height = height;
+    submitFrame(frameJob);
+    finishFrame(frameJob);
+}
+
+// Touch every tile of a fresh RGBA buffer from a thread on the node that will render it.
+// Only pinned threads (--pin) stay on one node; unpinned ones migrate, so touching pages early would
+// place them no better than the first render does, and the pass is skipped. It is also skipped on a
+// single node, where placement does not matter.
+void firstTouchFrameBuffer(sf::Uint8* pixels, int width, int height) {
+    if (workerCpus.empty() || numNodes <= 1) return;
+    const std::vector<Tile>& tiles = getTiles(width, height);
+    RenderJob job;
+    renderPool.submit(job, static_cast<int>(tiles.size()),
+        [&](int i) { return tileNode(tiles[i], height); },
+        [&](int i, int) {
+            const Tile& tile = tiles[i];
+            for (int y = tile.y0; y < tile.y1; y++) {
+                std::memset(pixels + (static_cast<size_t>(y) * width + tile.x0) * 4, 0, (tile.x1 - tile.x0) * 4);
+            }
+        });
+    renderPool.wait(job);
+}
+
+// Frames to keep in flight: one being rendered plus enough queued behind it
+// that threads finishing the current frame's tail always have tiles to move on to
+int chooseFramesInFlight(int width, int height) {
+    if (NUM_THREADS <= 1) return 1;
+    int tilesPerFrame = ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+    int frames = 1 + (NUM_THREADS * 8 + tilesPerFrame - 1) / tilesPerFrame;
+    return std::min(frames, 16);
+}
+
+// Shading pass: color a block of a results cell (from index `first`) into RGBA rows. Four pixels at a
+// time are turned into palette table entries with vector arithmetic and looked up together; groups with
+// a position outside the range the vector conversion handles (negative, NaN or huge), the row tails and
+// frames colored by histogram (`levels` given) use shadePixel.
+void shadeResults(const ResultCell& cell, int first, const RenderState& state, int blockWidth, int blockHeight,
+    sf::Uint8* out, size_t outStride, const float* levels = nullptr) {
+    const PaletteLut& palette = PALETTE_LUTS[state.colorScheme % PALETTE_LUTS.size()];
+    for (int y = 0; y < blockHeight; y++) {
+        const float* smooth = cell.smooth + first + y * TILE_SIZE;
+        const uint16_t* stripe = cell.stripe + first + y * TILE_SIZE;
+        const uint8_t* flags = cell.flags + first + y * TILE_SIZE;
+        sf::Uint8* row = out + y * outStride;
+        int x = 0;
+#if defined(FRACTAL_SSE2)
+        const uint32_t* table = palette.colors.data();
+        const uint32_t black = packColor(sf::Color(0, 0, 0));
+        const __m128d scale = _mm_set1_pd(palette.scale);
+        const __m128d limit = _mm_set1_pd(2147483648.0);
+        for (; !levels && x + 4 <= blockWidth; x += 4) {
+            int32_t flagBytes;
+            std::memcpy(&flagBytes, flags + x, 4);
+            __m128i flag = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(flagBytes), _mm_setzero_si128()), _mm_setzero_si128());
+            __m128i interior = _mm_cmpeq_epi32(_mm_and_si128(flag, _mm_set1_epi32(RESULT_INTERIOR)), _mm_set1_epi32(RESULT_INTERIOR));
+            __m128 iterations;
+            if (state.stripes) {
+                __m128i average = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(stripe + x)), _mm_setzero_si128());
+                iterations = _mm_mul_ps(_mm_set1_ps(state.stripeIntensity), _mm_mul_ps(_mm_cvtepi32_ps(average), _mm_set1_ps(1.0f / 65535)));
+            }
+            else {
+                iterations = _mm_mul_ps(_mm_loadu_ps(smooth + x), _mm_set1_ps(state.colorDensity));
+            }
+            __m128d position[2] = {
+                _mm_mul_pd(_mm_cvtps_pd(iterations), scale),
+                _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(iterations, iterations)), scale)
+            };
+            __m128d valid[2];
+            for (int half = 0; half < 2; half++) {
+                valid[half] = _mm_and_pd(_mm_cmpge_pd(position[half], _mm_setzero_pd()), _mm_cmplt_pd(position[half], limit));
+            }
+            __m128 inRange = _mm_shuffle_ps(_mm_castpd_ps(valid[0]), _mm_castpd_ps(valid[1]), _MM_SHUFFLE(2, 0, 2, 0));
+            if (_mm_movemask_ps(_mm_or_ps(inRange, _mm_castsi128_ps(interior))) != 0xF) {
+                for (int i = x; i < x + 4; i++) {
+                    uint32_t color = packColor(shadePixel({ smooth[i], stripe[i], flags[i] }, state, palette));
+                    std::memcpy(row + i * 4, &color, 4);
+                }
+                continue;
+            }
+
+            // Positions are non-negative here, so truncation is floor
+            __m128i entry = _mm_unpacklo_epi64(_mm_cvttpd_epi32(position[0]), _mm_cvttpd_epi32(position[1]));
+            alignas(16) int32_t entries[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(entries), _mm_and_si128(entry, _mm_set1_epi32(PALETTE_LUT_SIZE - 1)));
+            __m128i colors = _mm_set_epi32(table[entries[3]], table[entries[2]], table[entries[1]], table[entries[0]]);
+            colors = _mm_or_si128(_mm_andnot_si128(interior, colors), _mm_and_si128(interior, _mm_set1_epi32(black)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x * 4), colors);
+        }
+#elif defined(FRACTAL_NEON) && defined(__aarch64__)
+        const uint32_t* table = palette.colors.data();
+        const uint32_t black = packColor(sf::Color(0, 0, 0));
+        const float64x2_t scale = vdupq_n_f64(palette.scale);
+        const float64x2_t limit = vdupq_n_f64(2147483648.0);
+        for (; !levels && x + 4 <= blockWidth; x += 4) {
+            const uint32_t flagQuad[4] = { flags[x], flags[x + 1], flags[x + 2], flags[x + 3] };
+            uint32x4_t interior = vtstq_u32(vld1q_u32(flagQuad), vdupq_n_u32(RESULT_INTERIOR));
+            float32x4_t iterations;
+            if (state.stripes) {
+                float32x4_t average = vcvtq_f32_u32(vmovl_u16(vld1_u16(stripe + x)));
+                iterations = vmulq_f32(vdupq_n_f32(state.stripeIntensity), vmulq_f32(average, vdupq_n_f32(1.0f / 65535)));
+            }
+            else {
+                iterations = vmulq_f32(vld1q_f32(smooth + x), vdupq_n_f32(state.colorDensity));
+            }
+            float64x2_t position[2] = {
+                vmulq_f64(vcvt_f64_f32(vget_low_f32(iterations)), scale),
+                vmulq_f64(vcvt_f64_f32(vget_high_f32(iterations)), scale)
+            };
+            uint32x2_t valid[2];
+            for (int half = 0; half < 2; half++) {
+                valid[half] = vmovn_u64(vandq_u64(vcgeq_f64(position[half], vdupq_n_f64(0.0)), vcltq_f64(position[half], limit)));
+            }
+            if (vminvq_u32(vorrq_u32(vcombine_u32(valid[0], valid[1]), interior)) == 0) {
+                for (int i = x; i < x + 4; i++) {
+                    uint32_t color = packColor(shadePixel({ smooth[i], stripe[i], flags[i] }, state, palette));
+                    std::memcpy(row + i * 4, &color, 4);
+                }
+                continue;
+            }
+
+            // Positions are non-negative here, so truncation is floor
+            int32x4_t entry = vcombine_s32(vmovn_s64(vcvtq_s64_f64(position[0])), vmovn_s64(vcvtq_s64_f64(position[1])));
+            int32_t entries[4];
+            vst1q_s32(entries, vandq_s32(entry, vdupq_n_s32(PALETTE_LUT_SIZE - 1)));
+            const uint32_t gathered[4] = { table[entries[0]], table[entries[1]], table[entries[2]], table[entries[3]] };
+            uint32x4_t colors = vbslq_u32(interior, vdupq_n_u32(black), vld1q_u32(gathered));
+            vst1q_u32(reinterpret_cast<uint32_t*>(row + x * 4), colors);
+        }
+#endif
+        for (; x < blockWidth; x++) {
+            uint32_t color = packColor(shadePixel({ smooth[x], stripe[x], flags[x] }, state, palette, levels));
+            std::memcpy(row + x * 4, &color, 4);
+        }
+    }
+}
+
+// Render one tile: iterate it into packed results, shade those into a local buffer, then write the tile
+// to the frame row by row. The results go to the tile's cell of `results` (a frame's cells) when given,
+// so a coloring-only change can re-shade the frame without iterating again. A tile colored by
+// histogram only leaves its results; finishFrame shades it. Anti-aliased pixels average the colors of
+// their samples, so they are shaded directly and leave no results.
+// Returns the number of iterations spent.
+uint64_t renderFractalTile(sf::Uint8* pixels, ResultCell* results, const RenderState& state, const Tile& tile, int width, int height, sf::Uint8* tileBuffer) {
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double halfHeight = state.viewportHeight / 2;
+    double halfWidth = state.getViewportWidth() / 2;
+    const PaletteLut& palette = PALETTE_LUTS[state.colorScheme % PALETTE_LUTS.size()];
+    int tileWidth = tile.x1 - tile.x0;
+    int tileHeight = tile.y1 - tile.y0;
+    uint64_t cost = 0;
+
+    if (state.antiAliasing) {
+        // Adaptive anti-aliasing: one sample at the center of every pixel of the tile and of a one pixel
+        // border around it, then only pixels that break from their neighbors (an interior boundary, or
+        // anything but a linear gradient through them) are supersampled
+        thread_local sf::Color centers[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+        thread_local bool centerInterior[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+        const int border = tileWidth + 2;
+        for (int y = tile.y0 - 1; y <= tile.y1; y++) {
+            for (int x = tile.x0 - 1; x <= tile.x1; x++) {
+                int i = (y - tile.y0 + 1) * border + x - tile.x0 + 1;
+                centers[i] = sampleColor(x, y, AA_MAX_SAMPLES / 2, AA_MAX_SAMPLES / 2, state, width, height, palette, centerInterior[i], cost);
+            }
+        }
+
+        for (int y = tile.y0; y < tile.y1; y++) {
+            sf::Uint8* row = tileBuffer + (y - tile.y0) * tileWidth * 4;
+            for (int x = tile.x0; x < tile.x1; x++) {
+                int i = (y - tile.y0 + 1) * border + x - tile.x0 + 1;
+                bool edge = isEdgePixel(centers, centerInterior, i, border);
+                sf::Color color = edge ? supersamplePixel(x, y, centers[i], centerInterior[i], state, width, height, palette, cost) : centers[i];
+                int pixelIndex = (x - tile.x0) * 4;
+                row[pixelIndex] = color.r;
+                row[pixelIndex + 1] = color.g;
+                row[pixelIndex + 2] = color.b;
+                row[pixelIndex + 3] = 255;
+            }
+        }
+    }
+    else {
+        // Compute pass
+        thread_local ResultCell localCell;
+        ResultCell& cell = results ? resultCell(results, width, tile.x0, tile.y0) : localCell;
+        int first = cellIndex(tile.x0, tile.y0);
+        for (int y = tile.y0; y < tile.y1; y++) {
+            int i = first + (y - tile.y0) * TILE_SIZE;
+            for (int x = tile.x0; x < tile.x1; x++, i++) {
+                double cr = state.viewportX - halfWidth + x * pixelWidth;
+                double ci = state.viewportY - halfHeight + y * pixelHeight;
+
+                ReturnInfo info = calculateFractal(cr, ci, state.juliaX, state.juliaY,
+                    state.maxIterations, state.showJulia, state.fractalType, state.stripes, state.stripeFrequency, state.innerCalculation);
+                cost += info.cost;
+                PackedResult packed = packResult(info);
+                cell.smooth[i] = packed.smooth;
+                cell.stripe[i] = packed.stripe;
+                cell.flags[i] = packed.flags;
+            }
+        }
+
+        if (results && equalizedColors(state)) return cost;
+        shadeResults(cell, first, state, tileWidth, tileHeight, tileBuffer, tileWidth * 4);
+    }
+
+    // Write the finished tile out as whole rows
+    for (int y = tile.y0; y < tile.y1; y++) {
+        std::memcpy(pixels + (static_cast<size_t>(y) * width + tile.x0) * 4,
+            tileBuffer + (y - tile.y0) * tileWidth * 4, tileWidth * 4);
+    }
+    return cost;
+}
+
+// True if two states iterate every pixel identically, so one's results can be shaded with the other's coloring
+bool sameIterations(const RenderState& a, const RenderState& b) {
+    return a.viewportX == b.viewportX && a.viewportY == b.viewportY && a.viewportHeight == b.viewportHeight &&
+        a.aspectRatio == b.aspectRatio && a.maxIterations == b.maxIterations && a.showJulia == b.showJulia &&
+        a.juliaX == b.juliaX && a.juliaY == b.juliaY && a.fractalType == b.fractalType && a.stripes == b.stripes &&
+        a.stripeFrequency == b.stripeFrequency && a.innerCalculation == b.innerCalculation &&
+        !a.antiAliasing && !b.antiAliasing;
+}
+
+// Queue a frame that only re-colors another frame's finished results (possibly its own) on the pool,
+// ahead of queued frames since callers wait for it. The results (and histogram levels) are copied along,
+// so the frame can be re-shaded in turn after `source` is reused.
+void submitShading(FrameInFlight& frameJob, const FrameInFlight& source) {
+    frameJob.units.clear();
+    frameJob.hasResults = true;
+    if (&frameJob != &source) {
+        frameJob.levels.resize(source.levels.size());
+        std::copy(source.levels.begin(), source.levels.end(), frameJob.levels.begin());
+    }
+    frameJob.tiles = &getTiles(frameJob.width, frameJob.height);
+    renderPool.submit(frameJob.job, static_cast<int>(frameJob.tiles->size()),
+        [&](int i) { return tileNode((*frameJob.tiles)[i], frameJob.height); },
+        [&frameJob, &source](int i, int) {
+            const Tile& tile = (*frameJob.tiles)[i];
+            const float* levels = equalizedColors(frameJob.state) ? frameJob.levels.data() : nullptr;
+            const ResultCell& cell = resultCell(source.results, frameJob.width, tile.x0, tile.y0);
+            if (frameJob.results != source.results) resultCell(frameJob.results, frameJob.width, tile.x0, tile.y0) = cell;
+            size_t first = static_cast<size_t>(tile.y0) * frameJob.width + tile.x0;
+            shadeResults(cell, 0, frameJob.state, tile.x1 - tile.x0, tile.y1 - tile.y0,
+                frameJob.pixels + first * 4, static_cast<size_t>(frameJob.width) * 4, levels);
+        }, true);
+}
+
+// Histogram coloring: count the frame's escaped pixels per smooth iteration bin into one histogram per
+// pool thread (no sharing, so no locks), then merge the histograms and prefix-sum them on the pool a
+// chunk of bins at a time, and turn the running totals into the frame's levels
+void equalizeColors(FrameInFlight& frameJob) {
+    const int bins = frameJob.state.maxIterations + 1;
+    frameJob.histograms.resize(static_cast<size_t>(NUM_THREADS) * bins);
+    std::fill(frameJob.histograms.begin(), frameJob.histograms.end(), 0);
+
+    // Passes capture only the frame (and its tiles) and read everything else from it
+    frameJob.tiles = &getTiles(frameJob.width, frameJob.height);
+    renderPool.submit(frameJob.job, static_cast<int>(frameJob.tiles->size()),
+        [&](int i) { return tileNode((*frameJob.tiles)[i], frameJob.height); },
+        [&frameJob](int i, int thread) {
+            const Tile& tile = (*frameJob.tiles)[i];
+            const int maxIterations = frameJob.state.maxIterations;
+            uint32_t* counts = frameJob.histograms.data() + static_cast<size_t>(thread) * (maxIterations + 1);
+            const ResultCell& cell = resultCell(frameJob.results, frameJob.width, tile.x0, tile.y0);
+            for (int y = 0; y < tile.y1 - tile.y0; y++) {
+                for (int i = y * TILE_SIZE; i < y * TILE_SIZE + tile.x1 - tile.x0; i++) {
+                    if (!(cell.flags[i] & RESULT_INTERIOR)) counts[histogramBin(cell.smooth[i], maxIterations)]++;
+                }
+            }
+        }, true);
+    renderPool.wait(frameJob.job);
+
+    // Merge every thread's counts into the first histogram, summing each chunk as it goes
+    const int chunks = (bins + HISTOGRAM_CHUNK - 1) / HISTOGRAM_CHUNK;
+    frameJob.chunkStarts.resize(chunks + 1);
+    frameJob.chunkStarts[0] = 0;
+    renderPool.submit(frameJob.job, chunks, [](int) { return 0; },
+        [&frameJob](int chunk, int) {
+            const int bins = frameJob.state.maxIterations + 1;
+            uint32_t* histograms = frameJob.histograms.data();
+            uint64_t sum = 0;
+            for (int bin = chunk * HISTOGRAM_CHUNK; bin < std::min(bins, (chunk + 1) * HISTOGRAM_CHUNK); bin++) {
+                for (int thread = 1; thread < NUM_THREADS; thread++) {
+                    histograms[bin] += histograms[static_cast<size_t>(thread) * bins + bin];
+                }
+                sum += histograms[bin];
+            }
+            frameJob.chunkStarts[chunk + 1] = sum;
+        }, true);
+    renderPool.wait(frameJob.job);
+
+    uint64_t* chunkStarts = frameJob.chunkStarts.data();
+    for (int chunk = 0; chunk < chunks; chunk++) chunkStarts[chunk + 1] += chunkStarts[chunk];
+    const double total = static_cast<double>(std::max<uint64_t>(chunkStarts[chunks], 1));
+
+    // Running totals within each chunk, offset by the chunks before it. Levels are cleared for every
+    // frame, so room to spare keeps a slowly rising iteration limit from reallocating them each time.
+    if (frameJob.levels.capacity() < static_cast<size_t>(bins) + 1) frameJob.levels.reserve(2 * (static_cast<size_t>(bins) + 1));
+    frameJob.levels.resize(bins + 1);
+    renderPool.submit(frameJob.job, chunks, [](int) { return 0; },
+        [&frameJob](int chunk, int) {
+            const int bins = frameJob.state.maxIterations + 1;
+            const uint32_t* histograms = frameJob.histograms.data();
+            const double total = static_cast<double>(std::max<uint64_t>(frameJob.chunkStarts.back(), 1));
+            uint64_t below = frameJob.chunkStarts[chunk];
+            for (int bin = chunk * HISTOGRAM_CHUNK; bin < std::min(bins, (chunk + 1) * HISTOGRAM_CHUNK); bin++) {
+                frameJob.levels[bin] = static_cast<float>(below / total);
+                below += histograms[bin];
+            }
+        }, true);
+    renderPool.wait(frameJob.job);
+    frameJob.levels[bins] = static_cast<float>(chunkStarts[chunks] / total);
+}
+
+// Re-color a frame from the results of its last render, without iterating
+void reshadeFractal(sf::Uint8* pixels, ResultCell* results, const RenderState& state, int width, int height) {
+    static FrameInFlight frameJob;
+    frameJob.state = state;
+    frameJob.pixels = pixels;
+    frameJob.results = results;
+    frameJob.width = width;
+    frameJob.height = height;
+    if (equalizedColors(state)) equalizeColors(frameJob);
+    submitShading(frameJob, frameJob);
+    renderPool.wait(frameJob.job);
+}
+
+// Hash of a pixel position, so per-pixel jitter has no visible pattern
+inline uint32_t hashPixel(int x, int y) {
+    uint32_t h = static_cast<uint32_t>(x) * 0x8da6b343u ^ static_cast<uint32_t>(y) * 0xd8163841u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// Progressive anti-aliasing for the interactive window. The one-sample frame is shown at once, and the
+// adaptive pass's edge test picks the pixels worth refining. Idle pool threads then add one jittered
+// sample per edge pixel per pass into a float accumulation buffer, and write the running mean back into
+// the frame between passes, never while it is being shown. Refinement ends at AA_PROGRESSIVE_SAMPLES
+// samples, or earlier once a pass leaves almost every edge pixel settled; cancel() abandons the pass in
+// flight within a row per thread.
+class ProgressiveAA {
+public:
+    // Start refining a frame just rendered from `state` (one sample per pixel, at the pixel corners) and
+    // already shown; the first pass is queued at once. The frame's iteration results give the edge test
+    // its interior flags, and its histogram levels under histogram coloring.
+    void start(sf::Uint8* pixels, ResultCell* results, const RenderState& state, int width, int height) {
+        cancel();
+        frame.state = state;
+        frame.pixels = pixels;
+        frame.results = results;
+        frame.width = width;
+        frame.height = height;
+        frame.levels.clear();
+        if (results && equalizedColors(state)) equalizeColors(frame);
+        frame.tiles = &getTiles(width, height);
+
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        if (sums.size() < pixelCount * 3) sums.resize(pixelCount * 3);
+        if (edges.size() < pixelCount) edges.resize(pixelCount);
+        unsettled.resize(frame.tiles->size());
+        findEdges();
+        samples = 1;
+        active = edgePixels > 0;
+        if (active) submitPass();
+    }
+
+    // Take in a finished pass. True if the frame changed and should be shown again; the next pass waits
+    // for refine(), so nothing writes the frame while it is copied out
+    bool update() {
+        if (!passQueued || !renderPool.isFinished(frame.job)) return false;
+        passQueued = false;
+        samples++;
+        size_t unsettledPixels = 0;
+        for (int count : unsettled) unsettledPixels += count;
+        bool settled = samples >= AA_PROGRESSIVE_MIN_SAMPLES && unsettledPixels <= (1 - AA_SETTLED_FRACTION) * edgePixels;
+        if (samples >= AA_PROGRESSIVE_SAMPLES || settled) active = false;
+        return true;
+    }
+
+    // Queue the next pass, once the frame left by the last one has been shown
+    void refine() {
+        if (active && !passQueued) submitPass();
+    }
+
+    // Stop refining; the frame may be left partly refined, so callers render over it
+    void cancel() {
+        if (!active) return;
+        cancelled = true;
+        renderPool.wait(frame.job);
+        cancelled = false;
+        active = false;
+        passQueued = false;
+    }
+
+    int sampleCount() const { return samples; }
+
+private:
+    // Mark the pixels the adaptive pass would supersample, from the shown frame's colors and interior
+    // flags; a pixel on the frame's border reads its nearest in-frame neighbors
+    void findEdges() {
+        renderPool.submit(frame.job, static_cast<int>(frame.tiles->size()),
+            [&](int i) { return tileNode((*frame.tiles)[i], frame.height); },
+            [this](int tileIndex, int) {
+                thread_local sf::Color colors[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+                thread_local bool interior[(TILE_SIZE + 2) * (TILE_SIZE + 2)];
+                const Tile& tile = (*frame.tiles)[tileIndex];
+                const int border = tile.x1 - tile.x0 + 2;
+                for (int y = tile.y0 - 1; y <= tile.y1; y++) {
+                    int sy = std::min(std::max(y, 0), frame.height - 1);
+                    for (int x = tile.x0 - 1; x <= tile.x1; x++) {
+                        int sx = std::min(std::max(x, 0), frame.width - 1);
+                        int i = (y - tile.y0 + 1) * border + x - tile.x0 + 1;
+                        const sf::Uint8* pixel = frame.pixels + (static_cast<size_t>(sy) * frame.width + sx) * 4;
+                        colors[i] = sf::Color(pixel[0], pixel[1], pixel[2]);
+                        interior[i] = frame.results &&
+                            (resultCell(frame.results, frame.width, sx, sy).flags[cellIndex(sx, sy)] & RESULT_INTERIOR);
+                    }
+                }
+                int count = 0;
+                for (int y = tile.y0; y < tile.y1; y++) {
+                    for (int x = tile.x0; x < tile.x1; x++) {
+                        bool edge = isEdgePixel(colors, interior, (y - tile.y0 + 1) * border + x - tile.x0 + 1, border);
+                        edges[static_cast<size_t>(y) * frame.width + x] = edge;
+                        count += edge;
+                    }
+                }
+                unsettled[tileIndex] = count;
+            }, true);
+        renderPool.wait(frame.job);
+        edgePixels = 0;
+        for (int count : unsettled) edgePixels += count;
+    }
+
+    void submitPass() {
+        passQueued = true;
+        renderPool.submit(frame.job, static_cast<int>(frame.tiles->size()),
+            [&](int i) { return tileNode((*frame.tiles)[i], frame.height); },
+            [this](int i, int) { refineTile(i); });
+    }
+
+    void refineTile(int tileIndex) {
+        const Tile& tile = (*frame.tiles)[tileIndex];
+        const RenderState& state = frame.state;
+        const PaletteLut& palette = PALETTE_LUTS[state.colorScheme % PALETTE_LUTS.size()];
+        const float* levels = frame.levels.empty() ? nullptr : frame.levels.data();
+
+        // This pass's point of the R2 low-discrepancy sequence, shifted by a per-pixel hash
+        const double jitterX = 0.5 + samples * 0.7548776662466927;
+        const double jitterY = 0.5 + samples * 0.5698402909980532;
+        const float scale = 1.0f / (samples + 1);
+        uint64_t cost = 0;
+        int unsettledPixels = 0;
+        for (int y = tile.y0; y < tile.y1; y++) {
+            if (cancelled.load(std::memory_order_relaxed)) return;
+            for (int x = tile.x0; x < tile.x1; x++) {
+                if (!edges[static_cast<size_t>(y) * frame.width + x]) continue;
+                uint32_t hash = hashPixel(x, y);
+                double offsetX = jitterX + (hash & 0xFFFF) / 65536.0;
+                double offsetY = jitterY + (hash >> 16) / 65536.0;
+                bool interior;
+                sf::Color color = sampleColorAt(x + offsetX - std::floor(offsetX), y + offsetY - std::floor(offsetY),
+                    state, frame.width, frame.height, palette, interior, cost, levels);
+
+                size_t index = static_cast<size_t>(y) * frame.width + x;
+                float* sum = sums.data() + index * 3;
+                sf::Uint8* out = frame.pixels + index * 4;
+                if (samples == 1) {
+                    // The frame on screen is the first sample
+                    sum[0] = out[0];
+                    sum[1] = out[1];
+                    sum[2] = out[2];
+                }
+                sum[0] += color.r;
+                sum[1] += color.g;
+                sum[2] += color.b;
+                bool moved = false;
+                for (int c = 0; c < 3; c++) {
+                    int mean = static_cast<int>(sum[c] * scale + 0.5f);
+                    moved = moved || std::abs(mean - out[c]) > AA_SETTLED_CHANGE;
+                    out[c] = static_cast<sf::Uint8>(mean);
+                }
+                unsettledPixels += moved;
+            }
+        }
+        unsettled[tileIndex] = unsettledPixels;
+    }
+
+    FrameInFlight frame;
+    std::vector<float> sums;      // RGB sum of every edge pixel's samples so far
+    std::vector<uint8_t> edges;   // 1 for the pixels being refined
+    size_t edgePixels = 0;
+    std::vector<int> unsettled;   // pixels of each tile the last pass moved noticeably
+    int samples = 0;              // samples per pixel in the frame, including the one it was rendered with
+    bool active = false;
+    bool passQueued = false;
+    std::atomic<bool> cancelled{ false };
+};
+
+// Box filter a band of output rows [firstRow, lastRow): each output pixel is the rounded mean of its
+// factor x factor block. Input rows are summed into 16-bit channel totals with vector adds, then each
+// output pixel adds up its `factor` totals per channel.
+void downsampleBox(const sf::Uint8* in, int inWidth, sf::Uint8* out, int outWidth, int factor, int firstRow, int lastRow) {
+    thread_local std::vector<uint16_t> sums;
+    const int rowBytes = inWidth * 4;
+    if (sums.size() < static_cast<size_t>(rowBytes)) sums.resize(rowBytes);
+    const int area = factor * factor;
+
+    for (int y = firstRow; y < lastRow; y++) {
+        std::fill(sums.begin(), sums.begin() + rowBytes, 0);
+        for (int k = 0; k < factor; k++) {
+            const sf::Uint8* row = in + (static_cast<size_t>(y) * factor + k) * rowBytes;
+            uint16_t* sum = sums.data();
+            int i = 0;
+#if defined(FRACTAL_SSE2)
+            for (; i + 16 <= rowBytes; i += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+                __m128i* lo = reinterpret_cast<__m128i*>(sum + i);
+                __m128i* hi = reinterpret_cast<__m128i*>(sum + i + 8);
+                _mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo), _mm_unpacklo_epi8(bytes, _mm_setzero_si128())));
+                _mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi), _mm_unpackhi_epi8(bytes, _mm_setzero_si128())));
+            }
+#elif defined(FRACTAL_NEON)
+            for (; i + 16 <= rowBytes; i += 16) {
+                uint8x16_t bytes = vld1q_u8(row + i);
+                vst1q_u16(sum + i, vaddw_u8(vld1q_u16(sum + i), vget_low_u8(bytes)));
+                vst1q_u16(sum + i + 8, vaddw_u8(vld1q_u16(sum + i + 8), vget_high_u8(bytes)));
+            }
+#endif
+            for (; i < rowBytes; i++) sum[i] += row[i];
+        }
+
+        sf::Uint8* outRow = out + static_cast<size_t>(y) * outWidth * 4;
+        for (int x = 0; x < outWidth; x++) {
+            const uint16_t* block = sums.data() + static_cast<size_t>(x) * factor * 4;
+            for (int c = 0; c < 4; c++) {
+                uint32_t total = 0;
+                for (int k = 0; k < factor; k++) total += block[k * 4 + c];
+                outRow[x * 4 + c] = static_cast<sf::Uint8>((total + area / 2) / area);
+            }
+        }
+    }
+}
+
+// Taps of a Lanczos kernel that shrinks by an integer factor. Output pixel x covers input pixels
+// [x factor, (x + 1) factor); tap j reads input pixel x factor + first + j. The same weights serve
+// every output pixel in both directions. Built on first use of a factor; callers on the pool only read.
+struct LanczosKernel {
+    int factor = 0;
+    int first = 0;
+    std::vector<float> weights;
+};
+
+const LanczosKernel& getLanczosKernel(int factor) {
+    static LanczosKernel kernel;
+    if (kernel.factor != factor) {
+        kernel.factor = factor;
+        kernel.first = factor / 2 - LANCZOS_LOBES * factor;
+        kernel.weights.resize(2 * LANCZOS_LOBES * factor);
+        const double pi = 3.14159265358979323846;
+        auto sinc = [&](double t) { return t == 0 ? 1.0 : std::sin(pi * t) / (pi * t); };
+        double total = 0;
+        std::vector<double> weights(kernel.weights.size());
+        for (size_t j = 0; j < weights.size(); j++) {
+            // Distance from the output pixel's center, in output pixels
+            double t = (kernel.first + static_cast<int>(j) + 0.5 - factor * 0.5) / factor;
+            weights[j] = std::abs(t) < LANCZOS_LOBES ? sinc(t) * sinc(t / LANCZOS_LOBES) : 0.0;
+            total += weights[j];
+        }
+        for (size_t j = 0; j < weights.size(); j++) kernel.weights[j] = static_cast<float>(weights[j] / total);
+    }
+    return kernel;
+}
+
+// Lanczos filter a band of output rows [firstRow, lastRow), separably: each input row the band reaches is
+// widened to floats (with its border pixels repeated past the ends) and filtered horizontally, then output
+// rows sum those filtered rows. One RGBA pixel is one vector of four floats; results are rounded and clamped.
+void downsampleLanczos(const sf::Uint8* in, int inWidth, int inHeight, sf::Uint8* out, int outWidth, int factor,
+    int firstRow, int lastRow) {
+    const LanczosKernel& kernel = getLanczosKernel(factor);
+    const int taps = static_cast<int>(kernel.weights.size());
+    const float* weights = kernel.weights.data();
+    const int rowFloats = outWidth * 4;
+    const int inFirst = std::max(0, firstRow * factor + kernel.first);
+    const int inLast = std::min(inHeight - 1, (lastRow - 1) * factor + kernel.first + taps - 1);
+    const int pad = taps; // more than any tap reaches past either end
+
+    thread_local std::vector<float> filtered, line, sums;
+    const size_t needed = static_cast<size_t>(inLast - inFirst + 1) * rowFloats;
+    if (filtered.size() < needed) filtered.resize(needed);
+    if (line.size() < static_cast<size_t>(inWidth + 2 * pad) * 4) line.resize(static_cast<size_t>(inWidth + 2 * pad) * 4);
+    if (sums.size() < static_cast<size_t>(rowFloats)) sums.resize(rowFloats);
+
+    // Horizontal pass
+    for (int y = inFirst; y <= inLast; y++) {
+        const sf::Uint8* row = in + static_cast<size_t>(y) * inWidth * 4;
+        float* widened = line.data() + pad * 4;
+        int i = 0;
+#if defined(FRACTAL_SSE2)
+        for (; i + 16 <= inWidth * 4; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+            __m128i lo = _mm_unpacklo_epi8(bytes, _mm_setzero_si128()), hi = _mm_unpackhi_epi8(bytes, _mm_setzero_si128());
+            _mm_storeu_ps(widened + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, _mm_setzero_si128())));
+            _mm_storeu_ps(widened + i + 4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, _mm_setzero_si128())));
+            _mm_storeu_ps(widened + i + 8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, _mm_setzero_si128())));
+            _mm_storeu_ps(widened + i + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, _mm_setzero_si128())));
+        }
+#elif defined(FRACTAL_NEON) && defined(__aarch64__)
+        for (; i + 8 <= inWidth * 4; i += 8) {
+            uint16x8_t words = vmovl_u8(vld1_u8(row + i));
+            vst1q_f32(widened + i, vcvtq_f32_u32(vmovl_u16(vget_low_u16(words))));
+            vst1q_f32(widened + i + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(words))));
+        }
+#endif
+        for (; i < inWidth * 4; i++) widened[i] = row[i];
+        for (int x = 0; x < pad; x++) {
+            for (int c = 0; c < 4; c++) {
+                line[x * 4 + c] = row[c];
+                line[(pad + inWidth + x) * 4 + c] = row[(inWidth - 1) * 4 + c];
+            }
+        }
+        float* dst = filtered.data() + static_cast<size_t>(y - inFirst) * rowFloats;
+        for (int x = 0; x < outWidth; x++) {
+            const float* source = line.data() + (x * factor + kernel.first + pad) * 4;
+#if defined(FRACTAL_SSE2)
+            __m128 sum = _mm_setzero_ps();
+            for (int j = 0; j < taps; j++) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[j]), _mm_loadu_ps(source + j * 4)));
+            }
+            _mm_storeu_ps(dst + x * 4, sum);
+#elif defined(FRACTAL_NEON) && defined(__aarch64__)
+            float32x4_t sum = vdupq_n_f32(0);
+            for (int j = 0; j < taps; j++) {
+                sum = vaddq_f32(sum, vmulq_n_f32(vld1q_f32(source + j * 4), weights[j]));
+            }
+            vst1q_f32(dst + x * 4, sum);
+#else
+            for (int c = 0; c < 4; c++) {
+                float sum = 0;
+                for (int j = 0; j < taps; j++) sum += weights[j] * source[j * 4 + c];
+                dst[x * 4 + c] = sum;
+            }
+#endif
+        }
+    }
+
+    // Vertical pass, a whole filtered row per tap
+    for (int y = firstRow; y < lastRow; y++) {
+        std::fill(sums.begin(), sums.begin() + rowFloats, 0.0f);
+        for (int j = 0; j < taps; j++) {
+            const int sourceRow = std::min(inLast, std::max(inFirst, y * factor + kernel.first + j));
+            const float* source = filtered.data() + static_cast<size_t>(sourceRow - inFirst) * rowFloats;
+            float* sum = sums.data();
+            int i = 0;
+#if defined(FRACTAL_SSE2)
+            const __m128 weight = _mm_set1_ps(weights[j]);
+            for (; i < rowFloats; i += 4) {
+                _mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(sum + i), _mm_mul_ps(weight, _mm_loadu_ps(source + i))));
+            }
+#elif defined(FRACTAL_NEON) && defined(__aarch64__)
+            for (; i < rowFloats; i += 4) {
+                vst1q_f32(sum + i, vaddq_f32(vld1q_f32(sum + i), vmulq_n_f32(vld1q_f32(source + i), weights[j])));
+            }
+#endif
+            for (; i < rowFloats; i++) sum[i] += weights[j] * source[i];
+        }
+
+        sf::Uint8* outRow = out + static_cast<size_t>(y) * outWidth * 4;
+        int i = 0;
+#if defined(FRACTAL_SSE2)
+        for (; i + 16 <= rowFloats; i += 16) {
+            __m128i a = _mm_packs_epi32(_mm_cvtps_epi32(_mm_loadu_ps(sums.data() + i)), _mm_cvtps_epi32(_mm_loadu_ps(sums.data() + i + 4)));
+            __m128i b = _mm_packs_epi32(_mm_cvtps_epi32(_mm_loadu_ps(sums.data() + i + 8)), _mm_cvtps_epi32(_mm_loadu_ps(sums.data() + i + 12)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(outRow + i), _mm_packus_epi16(a, b));
+        }
+#elif defined(FRACTAL_NEON) && defined(__aarch64__)
+        for (; i + 8 <= rowFloats; i += 8) {
+            int16x8_t value = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(vld1q_f32(sums.data() + i))), vqmovn_s32(vcvtnq_s32_f32(vld1q_f32(sums.data() + i + 4))));
+            vst1_u8(outRow + i, vqmovun_s16(value));
+        }
+#endif
+        for (; i < rowFloats; i++) {
+            outRow[i] = static_cast<sf::Uint8>(std::min(255.0f, std::max(0.0f, std::nearbyint(sums[i]))));
+        }
+    }
+}
+
+// Filter a supersampled frame down into its output, a band of output rows per pool unit
+void resolveFrame(FrameInFlight& frameJob) {
+    const int outHeight = frameJob.height / supersample;
+    if (resampleFilter == ResampleFilter::Lanczos) getLanczosKernel(supersample); // built here, before the pool reads it
+    renderPool.submit(frameJob.job, (outHeight + RESAMPLE_BAND_ROWS - 1) / RESAMPLE_BAND_ROWS,
+        [&](int band) { return std::min(numNodes - 1, band * RESAMPLE_BAND_ROWS * numNodes / outHeight); },
+        [&frameJob](int band, int) {
+            const int outWidth = frameJob.width / supersample;
+            const int firstRow = band * RESAMPLE_BAND_ROWS;
+            const int lastRow = std::min(frameJob.height / supersample, firstRow + RESAMPLE_BAND_ROWS);
+            if (resampleFilter == ResampleFilter::Lanczos) {
+                downsampleLanczos(frameJob.pixels, frameJob.width, frameJob.height, frameJob.output, outWidth, supersample, firstRow, lastRow);
+            }
+            else {
+                downsampleBox(frameJob.pixels, frameJob.width, frameJob.output, outWidth, supersample, firstRow, lastRow);
+            }
+        }, true);
+    renderPool.wait(frameJob.job);
+}
+
+// Iteration data of one point, kept instead of a color by renderers that resample earlier work,
+// so colorDensity and the iteration limit can still change from frame to frame
+struct IterationSample {
+    float smooth;
+    float stripe;      // stripeSum / iteration
+    int32_t iteration; // -1 inside the set at the sampling iteration limit
+};
+
+inline IterationSample sampleFractal(double cr, double ci, const RenderState& fractal, int maxIterations) {
+    ReturnInfo info = calculateFractal(cr, ci, fractal.juliaX, fractal.juliaY, maxIterations, fractal.showJulia,
+        fractal.fractalType, fractal.stripes, fractal.stripeFrequency, false);
+    IterationSample sample = { 0, 0, info.iteration };
+    if (info.iteration > 0) {
+        sample.smooth = static_cast<float>(info.smoothIteration);
+        sample.stripe = static_cast<float>(info.stripeSum / info.iteration);
+    }
+    return sample;
+}
+
+// Bilinear blend of four neighboring samples. Samples that would not have escaped within the frame's
+// iteration limit count as inside; across the set's boundary blending makes no sense, so there the nearest
+// sample decides. Returns false if the point is inside.
+inline bool interpolateSamples(const IterationSample& s00, const IterationSample& s01, const IterationSample& s10,
+    const IterationSample& s11, float fx, float fy, int maxIterations, float& smooth, float& stripe) {
+    auto escaped = [&](const IterationSample& sample) { return sample.iteration >= 0 && sample.iteration < maxIterations; };
+    if (escaped(s00) && escaped(s01) && escaped(s10) && escaped(s11)) {
+        float w00 = (1 - fx) * (1 - fy), w01 = fx * (1 - fy), w10 = (1 - fx) * fy, w11 = fx * fy;
+        smooth = s00.smooth * w00 + s01.smooth * w01 + s10.smooth * w10 + s11.smooth * w11;
+        stripe = s00.stripe * w00 + s01.stripe * w01 + s10.stripe * w10 + s11.stripe * w11;
+        return true;
+    }
+    const IterationSample& nearest = fy < 0.5f ? (fx < 0.5f ? s00 : s01) : (fx < 0.5f ? s10 : s11);
+    smooth = nearest.smooth;
+    stripe = nearest.stripe;
+    return escaped(nearest);
+}
+
+// Color of an escaped point from its iteration data, with a frame's own settings
+inline sf::Color shadeEscaped(float smooth, float stripe, const RenderState& state, const PaletteLut& palette) {
+    return lutColor(palette, state.stripes ? state.stripeIntensity * stripe : smooth * state.colorDensity);
+}
+
+// Color a point between four neighboring samples
+inline sf::Color shadeInterpolated(const IterationSample& s00, const IterationSample& s01, const IterationSample& s10,
+    const IterationSample& s11, float fx, float fy, const RenderState& state, const PaletteLut& palette) {
+    float smooth, stripe;
+    if (!interpolateSamples(s00, s01, s10, s11, fx, fy, state.maxIterations, smooth, stripe)) return sf::Color(0, 0, 0);
+    return shadeEscaped(smooth, stripe, state, palette);
+}
+
+// Zoom animations around a fixed center as one log-polar ("exponential map") strip plus a cheap warp per frame.
+// Strip row j, column k is the point center + R0 * exp(-j*delta) * e^(i*k*delta), delta = 2*pi / stripWidth,
+// so samples are square and every row is the previous one scaled by exp(-delta). A frame of height h sees the
+// pixel at distance rho (in pixels) from the center at strip row (ln(R0 * H / h) - ln rho) / delta: a fixed
+// per-pixel term plus one offset per frame. Rows are rendered in bands as the zoom reaches them and dropped
+// once it has passed them.
+typedef std::vector<IterationSample> ExpMapBand;
+
+// First frame of the animation, up to lastFrame, that a renderer zooming around the target can serve
+// (`serves`), or -1. The scan stops once the animation has settled on its target, since every later frame
+// iterates the same, so it ends even for an open-ended run.
+template <typename Serves>
+int firstServedFrame(const ZoomAnimation& animation, int lastFrame, Serves serves) {
+    for (int n = 0; n <= lastFrame; n++) {
+        RenderState state = animation.stateAt(n);
+        if (serves(state)) return n;
+        bool settled = state.viewportX == animation.targetX && state.viewportY == animation.targetY &&
+            state.viewportHeight == animation.targetHeight &&
+            (animation.targetIterations - state.maxIterations) / animation.easing == 0;
+        if (settled || n == lastFrame) break;
+    }
+    return -1;
+}
+
+class ExpMapRenderer {
+public:
+    // False if no frame up to lastFrame zooms around the target in a way the strip can reproduce
+    bool configure(const ZoomAnimation& animation, int lastFrame, int frameWidth, int frameHeight) {
+        fractal = animation.start;
+        centerX = animation.targetX;
+        centerY = animation.targetY;
+        // Iterations ease monotonically from the start's to the target's, so these two bound every frame
+        maxIterations = std::max(animation.start.maxIterations, animation.targetIterations);
+        width = frameWidth;
+        height = frameHeight;
+
+        // One sample per pixel along the frame's corner circle, finer everywhere inside it
+        double cornerRadius = std::sqrt(0.25 * width * width + 0.25 * height * height);
+        stripWidth = (static_cast<int>(std::ceil(TWO_PI * cornerRadius)) + 3) & ~3;
+        delta = TWO_PI / stripWidth;
+        angleCos.resize(stripWidth);
+        angleSin.resize(stripWidth);
+        for (int k = 0; k < stripWidth; k++) {
+            angleCos[k] = std::cos(k * delta);
+            angleSin[k] = std::sin(k * delta);
+        }
+
+        // Pixels nearer the center than half a pixel all read the row at half a pixel
+        baseTop = static_cast<float>(-std::log(cornerRadius) / delta);
+        baseBottom = static_cast<float>(-std::log(0.5) / delta);
+        pixelColumn.resize(static_cast<size_t>(width) * height);
+        pixelColumnFraction.resize(pixelColumn.size());
+        pixelRow.resize(pixelColumn.size());
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                double dx = x - 0.5 * width, dy = y - 0.5 * height;
+                double rho = std::max(0.5, std::sqrt(dx * dx + dy * dy));
+                double column = std::atan2(dy, dx) / delta;
+                if (column < 0) column += stripWidth;
+                size_t i = static_cast<size_t>(y) * width + x;
+                pixelColumn[i] = static_cast<int>(column) % stripWidth;
+                pixelColumnFraction[i] = static_cast<float>(column - std::floor(column));
+                pixelRow[i] = static_cast<float>(-std::log(rho) / delta);
+            }
+        }
+        bands.clear();
+
+        // The strip starts at the corner circle of the animation's first frame it can serve, whichever
+        // frames this run renders, so a frame's pixels never depend on where the run started
+        topRadius = 0;
+        int first = firstServedFrame(animation, lastFrame, [this](const RenderState& state) { return zoomsAtCenter(state); });
+        if (first < 0) return false;
+        topRadius = animation.stateAt(first).viewportHeight / height * cornerRadius;
+        return true;
+    }
+
+    // True if the frame is a zoom around the strip's center that the strip can still reach
+    bool covers(const RenderState& state) const {
+        return topRadius > 0 && zoomsAtCenter(state) && rowOffset(state) + baseTop > -0.5;
+    }
+
+    // Render the strip rows the frame needs (blocking), then queue its warp on the pool
+    void submitFrame(FrameInFlight& frameJob) {
+        const RenderState& state = frameJob.state;
+        double offset = rowOffset(state);
+        int firstRow = std::max(0, static_cast<int>(std::floor(offset + baseTop)));
+        int lastRow = static_cast<int>(std::floor(offset + baseBottom)) + 1;
+        int firstBand = firstRow / EXPMAP_BAND_ROWS;
+        int lastBand = lastRow / EXPMAP_BAND_ROWS;
+
+        // The zoom has moved past earlier bands; frames in flight keep their own references
+        bands.erase(bands.begin(), bands.lower_bound(firstBand));
+        renderBands(firstBand, lastBand);
+
+        auto frame = std::make_shared<FrameRows>();
+        frame->firstRow = firstRow;
+        frame->localOffset = static_cast<float>(offset - firstRow);
+        for (int band = firstBand; band <= lastBand; band++) frame->bands.push_back(bands[band]);
+        for (int row = firstRow; row <= lastRow; row++) {
+            frame->rows.push_back(frame->bands[row / EXPMAP_BAND_ROWS - firstBand]->data() + static_cast<size_t>(row % EXPMAP_BAND_ROWS) * stripWidth);
+        }
+
+        frameJob.units.clear();
+        frameJob.hasResults = false;
+        const std::vector<Tile>& tiles = getTiles(frameJob.width, frameJob.height);
+        renderPool.submit(frameJob.job, static_cast<int>(tiles.size()),
+            [&](int i) { return tileNode(tiles[i], frameJob.height); },
+            [this, &frameJob, &tiles, frame](int i, int) { warpTile(frameJob, tiles[i], *frame); });
+    }
+
+private:
+    static constexpr double TWO_PI = 6.283185307179586476925;
+
+    struct FrameRows {
+        int firstRow;
+        float localOffset; // strip row of a pixel = pixelRow + localOffset, relative to firstRow
+        std::vector<std::shared_ptr<const ExpMapBand>> bands;
+        std::vector<const IterationSample*> rows;
+    };
+
+    // True if the frame's view is centered on the strip and colored in a way the strip can reproduce
+    bool zoomsAtCenter(const RenderState& state) const {
+        if (state.viewportX != centerX || state.viewportY != centerY) return false;
+        if (state.antiAliasing || state.innerCalculation || state.maxIterations > maxIterations) return false;
+        return !equalizedColors(state); // colored from whole-frame results it doesn't keep
+    }
+
+    double rowOffset(const RenderState& state) const {
+        return std::log(topRadius * height / state.viewportHeight) / delta;
+    }
+
+    void renderBands(int firstBand, int lastBand) {
+        std::vector<int> missing;
+        for (int band = firstBand; band <= lastBand; band++) {
+            if (!bands.count(band)) missing.push_back(band);
+        }
+        if (missing.empty()) return;
+
+        std::vector<std::shared_ptr<ExpMapBand>> rendered;
+        for (size_t i = 0; i < missing.size(); i++) {
+            rendered.push_back(std::make_shared<ExpMapBand>(static_cast<size_t>(EXPMAP_BAND_ROWS) * stripWidth));
+        }
+
+        RenderJob job;
+        renderPool.submit(job, static_cast<int>(missing.size()) * EXPMAP_BAND_ROWS,
+            [](int i) { return i % numNodes; },
+            [&](int i, int) {
+                int row = missing[i / EXPMAP_BAND_ROWS] * EXPMAP_BAND_ROWS + i % EXPMAP_BAND_ROWS;
+                double radius = topRadius * std::exp(-row * delta);
+                IterationSample* out = rendered[i / EXPMAP_BAND_ROWS]->data() + static_cast<size_t>(i % EXPMAP_BAND_ROWS) * stripWidth;
+                for (int k = 0; k < stripWidth; k++) {
+                    out[k] = sampleFractal(centerX + radius * angleCos[k], centerY + radius * angleSin[k], fractal, maxIterations);
+                }
+            });
+        renderPool.wait(job);
+        for (size_t i = 0; i < missing.size(); i++) bands[missing[i]] = rendered[i];
+    }
+
+    // Resample one tile of a frame from the strip and color it with the frame's own settings
+    void warpTile(const FrameInFlight& frameJob, const Tile& tile, const FrameRows& frame) const {
+        const RenderState& state = frameJob.state;
+        const PaletteLut& palette = PALETTE_LUTS[state.colorScheme % PALETTE_LUTS.size()];
+        alignas(16) int32_t rowIndex[TILE_SIZE];
+        alignas(16) float rowFraction[TILE_SIZE];
+
+        for (int y = tile.y0; y < tile.y1; y++) {
+            size_t first = static_cast<size_t>(y) * width + tile.x0;
+            int count = tile.x1 - tile.x0;
+
+            // Strip row and blend weight of every pixel in the tile row
+            int x = 0;
+#if defined(FRACTAL_SSE2)
+            const __m128 offset = _mm_set1_ps(frame.localOffset);
+            for (; x + 4 <= count; x += 4) {
+                __m128 position = _mm_add_ps(_mm_loadu_ps(&pixelRow[first + x]), offset);
+                __m128i whole = _mm_cvttps_epi32(position); // positions are >= 0, so this is floor
+                _mm_store_si128(reinterpret_cast<__m128i*>(rowIndex + x), whole);
+                _mm_store_ps(rowFraction + x, _mm_sub_ps(position, _mm_cvtepi32_ps(whole)));
+            }
+#elif defined(FRACTAL_NEON)
+            const float32x4_t offset = vdupq_n_f32(frame.localOffset);
+            for (; x + 4 <= count; x += 4) {
+                float32x4_t position = vaddq_f32(vld1q_f32(&pixelRow[first + x]), offset);
+                int32x4_t whole = vcvtq_s32_f32(position);
+                vst1q_s32(rowIndex + x, whole);
+                vst1q_f32(rowFraction + x, vsubq_f32(position, vcvtq_f32_s32(whole)));
+            }
+#endif
+            for (; x < count; x++) {
+                float position = pixelRow[first + x] + frame.localOffset;
+                rowIndex[x] = static_cast<int32_t>(position);
+                rowFraction[x] = position - rowIndex[x];
+            }
+
+            sf::Uint8* out = frameJob.pixels + first * 4;
+            for (x = 0; x < count; x++) {
+                int row = std::min(rowIndex[x], static_cast<int>(frame.rows.size()) - 2);
+                int column = pixelColumn[first + x];
+                int nextColumn = column + 1 == stripWidth ? 0 : column + 1;
+                const IterationSample* upper = frame.rows[row];
+                const IterationSample* lower = frame.rows[row + 1];
+                sf::Color color = shadeInterpolated(upper[column], upper[nextColumn], lower[column], lower[nextColumn],
+                    pixelColumnFraction[first + x], rowFraction[x], state, palette);
+                out[x * 4] = color.r;
+                out[x * 4 + 1] = color.g;
+                out[x * 4 + 2] = color.b;
+                out[x * 4 + 3] = 255;
+            }
+        }
+    }
+
+    RenderState fractal;
+    double centerX = 0, centerY = 0;
+    int maxIterations = 0;
+    int width = 0, height = 0;
+    int stripWidth = 0;
+    double delta = 0;
+    double topRadius = 0; // R0, from the animation's first frame the strip serves; 0 if it serves none
+    float baseTop = 0, baseBottom = 0;
+    std::vector<double> angleCos, angleSin;
+    std::vector<int> pixelColumn;
+    std::vector<float> pixelColumnFraction;
+    std::vector<float> pixelRow; // -ln(distance from the center in pixels) / delta
+    std::map<int, std::shared_ptr<const ExpMapBand>> bands;
+};
+
+// When set, runAnimation produces the frames it covers by warping its strip instead of rendering them
+ExpMapRenderer* expMapRenderer = nullptr;
+
+// Zoom animations around a fixed center from exact keyframes at every 2x of zoom. Keyframe j shows twice the
+// height V_j = V_0 / 2^j at twice the output resolution, so it covers every frame of height h in [V_j, 2 V_j)
+// with 1-2 samples per output pixel; those frames are scaled crops of it. Keyframe j+1 covers the middle of
+// the same frames in finer detail and is faded in over the second half of the interval (and in from its
+// edge), reaching full weight exactly when it covers the whole frame, so switching keyframes leaves no seam
+// in space or time.
+// Per 2x of zoom this renders 4 frames' worth of pixels instead of the ~17 frames the default easing takes.
+class KeyframeRenderer {
+public:
+    // False if no frame up to lastFrame zooms around the target in a way keyframes can reproduce
+    bool configure(const ZoomAnimation& zoom, int lastFrame, int frameWidth, int frameHeight) {
+        animation = zoom;
+        width = frameWidth;
+        height = frameHeight;
+        keyframes.clear();
+
+        // The ladder starts at the animation's first frame around the target, whichever frames this run
+        // renders, so a frame's pixels never depend on where the run started
+        baseHeight = 0;
+        baseFrame = firstServedFrame(animation, lastFrame, [this](const RenderState& state) { return zoomsAtTarget(state); });
+        if (baseFrame < 0) return false;
+        baseHeight = animation.stateAt(baseFrame).viewportHeight;
+        return true;
+    }
+
+    // True if the frame is a zoom around the target no larger than the first keyframe
+    bool covers(const RenderState& state) const {
+        return baseHeight > 0 && zoomsAtTarget(state) && state.viewportHeight < 2 * baseHeight;
+    }
+
+    // Render the keyframes the frame needs (blocking), then queue its resampling on the pool
+    void submitFrame(FrameInFlight& frameJob) {
+        const RenderState& state = frameJob.state;
+
+        // Keyframe j serves heights in [V_j, 2 V_j)
+        int index = std::max(0, static_cast<int>(std::ceil(std::log2(baseHeight / state.viewportHeight) - 1e-9)));
+        keyframes.erase(keyframes.begin(), keyframes.lower_bound(index));
+        auto frame = std::make_shared<FramePair>();
+        frame->outer = keyframe(index);
+        frame->inner = keyframe(index + 1);
+
+        frameJob.units.clear();
+        frameJob.hasResults = false;
+        const std::vector<Tile>& tiles = getTiles(frameJob.width, frameJob.height);
+        renderPool.submit(frameJob.job, static_cast<int>(tiles.size()),
+            [&](int i) { return tileNode(tiles[i], frameJob.height); },
+            [this, &frameJob, &tiles, frame](int i, int) { resampleTile(frameJob, tiles[i], *frame); });
+    }
+
+private:
+    struct Keyframe {
+        double viewHeight; // 2 V_j
+        int maxIterations;
+        std::vector<IterationSample> samples; // (2 width) x (2 height)
+    };
+
+    struct FramePair {
+        std::shared_ptr<const Keyframe> outer, inner;
+    };
+
+    // True if the frame's view is centered on the target and colored in a way keyframes can reproduce
+    bool zoomsAtTarget(const RenderState& state) const {
+        if (state.viewportX != animation.targetX || state.viewportY != animation.targetY) return false;
+        return !state.antiAliasing && !state.innerCalculation && !equalizedColors(state);
+    }
+
+    std::shared_ptr<const Keyframe> keyframe(int index) {
+        auto found = keyframes.find(index);
+        if (found != keyframes.end()) return found->second;
+
+        auto key = std::make_shared<Keyframe>();
+        key->viewHeight = 2 * baseHeight / std::ldexp(1.0, index);
+
+        // Enough iterations for every frame of the animation that samples it: those of height in
+        // [V_j, 4 V_j), served by it or by the keyframe above it
+        key->maxIterations = animation.stateAt(baseFrame).maxIterations;
+        for (int n = baseFrame; n < baseFrame + 10000; n++) {
+            RenderState later = animation.stateAt(n);
+            if (later.viewportHeight < key->viewHeight / 2) break;
+            if (later.viewportHeight < 2 * key->viewHeight) key->maxIterations = std::max(key->maxIterations, later.maxIterations);
+        }
+
+        // Same corner-anchored sample grid as a direct render of that view at twice the size
+        const int keyWidth = 2 * width, keyHeight = 2 * height;
+        const double pixelSize = key->viewHeight / keyHeight;
+        const double left = animation.targetX - pixelSize * width;
+        const double top = animation.targetY - pixelSize * height;
+        key->samples.resize(static_cast<size_t>(keyWidth) * keyHeight);
+
+        RenderJob job;
+        Keyframe& target = *key;
+        renderPool.submit(job, keyHeight,
+            [&](int row) { return row * numNodes / keyHeight; },
+            [&](int row, int) {
+                IterationSample* out = target.samples.data() + static_cast<size_t>(row) * keyWidth;
+                for (int x = 0; x < keyWidth; x++) {
+                    out[x] = sampleFractal(left + x * pixelSize, top + row * pixelSize, animation.start, target.maxIterations);
+                }
+            });
+        renderPool.wait(job);
+
+        keyframes[index] = key;
+        return key;
+    }
+
+    // 2x2 bilinear taps spread over one output pixel at keyframe coordinates (x, y), `scale` keyframe pixels
+    // per output pixel, taps clamped to the keyframe. Where all taps are outside the set their iteration
+    // data is averaged and shaded once; near the set the four taps are shaded and their colors averaged.
+    sf::Color sampleKeyframe(const Keyframe& key, double x, double y, double scale, const RenderState& state,
+        const PaletteLut& palette) const {
+        const int keyWidth = 2 * width, keyHeight = 2 * height;
+        float smooth[4], stripe[4];
+        bool escaped[4];
+        for (int tap = 0; tap < 4; tap++) {
+            double tapX = std::min(std::max(x + scale * ((tap & 1) ? 0.25 : -0.25), 0.0), keyWidth - 1.001);
+            double tapY = std::min(std::max(y + scale * ((tap & 2) ? 0.25 : -0.25), 0.0), keyHeight - 1.001);
+            int ix = static_cast<int>(tapX), iy = static_cast<int>(tapY);
+            const IterationSample* upper = key.samples.data() + static_cast<size_t>(iy) * keyWidth + ix;
+            const IterationSample* lower = upper + keyWidth;
+            escaped[tap] = interpolateSamples(upper[0], upper[1], lower[0], lower[1],
+                static_cast<float>(tapX - ix), static_cast<float>(tapY - iy), state.maxIterations, smooth[tap], stripe[tap]);
+        }
+
+        if (escaped[0] && escaped[1] && escaped[2] && escaped[3]) {
+            return shadeEscaped(0.25f * (smooth[0] + smooth[1] + smooth[2] + smooth[3]),
+                0.25f * (stripe[0] + stripe[1] + stripe[2] + stripe[3]), state, palette);
+        }
+        int r = 0, g = 0, b = 0;
+        for (int tap = 0; tap < 4; tap++) {
+            if (!escaped[tap]) continue;
+            sf::Color color = shadeEscaped(smooth[tap], stripe[tap], state, palette);
+            r += color.r;
+            g += color.g;
+            b += color.b;
+        }
+        return sf::Color(static_cast<sf::Uint8>(r / 4), static_cast<sf::Uint8>(g / 4), static_cast<sf::Uint8>(b / 4));
+    }
+
+    void resampleTile(const FrameInFlight& frameJob, const Tile& tile, const FramePair& frame) const {
+        const RenderState& state = frameJob.state;
+        const PaletteLut& palette = PALETTE_LUTS[state.colorScheme % PALETTE_LUTS.size()];
+
+        // Output pixel x maps to keyframe pixel width * (1 - ratio) + 2 * ratio * x, ratio = h / keyframe view
+        double outerRatio = state.viewportHeight / frame.outer->viewHeight;
+        double innerRatio = state.viewportHeight / frame.inner->viewHeight;
+        // Fade in over the second half of the interval; the outer keyframe alone has enough samples before that
+        double fade = std::min(1.0, std::max(0.0, 2 * -std::log2(outerRatio) - 1));
+
+        // The inner keyframe's edge fades in over the margin it leaves (output pixels), so it has no hard border
+        double margin = std::max(1.0, 0.5 * height * (1 - 1 / innerRatio));
+
+        for (int y = tile.y0; y < tile.y1; y++) {
+            sf::Uint8* out = frameJob.pixels + (static_cast<size_t>(y) * width + tile.x0) * 4;
+            double outerY = height * (1 - outerRatio) + 2 * outerRatio * y;
+            double innerY = height * (1 - innerRatio) + 2 * innerRatio * y;
+
+            for (int x = tile.x0; x < tile.x1; x++, out += 4) {
+                sf::Color color = sampleKeyframe(*frame.outer, width * (1 - outerRatio) + 2 * outerRatio * x, outerY,
+                    2 * outerRatio, state, palette);
+
+                double innerX = width * (1 - innerRatio) + 2 * innerRatio * x;
+                double edge = std::min(std::min(innerX, 2.0 * width - 1 - innerX), std::min(innerY, 2.0 * height - 1 - innerY));
+                double weight = fade * std::min(1.0, std::max(0.0, edge / (2 * innerRatio) / margin));
+                if (weight > 0) {
+                    sf::Color inner = sampleKeyframe(*frame.inner, innerX, innerY, 2 * innerRatio, state, palette);
+                    color = interpolateColors(color, inner, weight);
+                }
+                out[0] = color.r;
+                out[1] = color.g;
+                out[2] = color.b;
+                out[3] = 255;
+            }
+        }
+    }
+
+    ZoomAnimation animation;
+    int width = 0, height = 0;
+    int baseFrame = 0;
+    double baseHeight = 0; // V_0, the height of the animation's first frame around the target; 0 if none
+    std::map<int, std::shared_ptr<const Keyframe>> keyframes;
+};
+
+// When set, runAnimation produces the frames it covers from keyframes instead of rendering them
+KeyframeRenderer* keyframeRenderer = nullptr;
+
+// Output file of an animation frame, written into `name` with `infix` before the extension
+void formatFrameFileName(char* name, size_t size, int frameNumber, const char* infix = "") {
+    static const char* extensions[] = { ".png", ".qoi", ".ppm", ".pam", ".tga" };
+    std::snprintf(name, size, "%d%s%s", frameNumber, infix, extensions[static_cast<int>(frameFormat)]);
+}
+
+std::string frameFileName(int frameNumber) {
+    char name[64];
+    formatFrameFileName(name, sizeof(name), frameNumber);
+    return name;
+}
+
+// Write a whole buffer; normally a single write() call, looping only on partial writes
+bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int written = _write(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+#endif
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Write a whole buffer at a file offset
+bool writeAllAt(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) return false;
+    return writeAll(fd, data, size);
+#else
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+#endif
+}
+
+// Read a whole buffer from a file offset
+bool readAllAt(int fd, uint8_t* data, size_t size, uint64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) return false;
+    while (size > 0) {
+        int got = _read(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+        if (got <= 0) return false;
+        data += got;
+        size -= got;
+    }
+    return true;
+#else
+    while (size > 0) {
+        ssize_t got = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        data += got;
+        size -= got;
+        offset += got;
+    }
+    return true;
+#endif
+}
+
+#ifdef FRACTAL_IO_URING
+// Minimal io_uring over the raw syscalls: one ring per encoder thread with IO_RING_SLOTS registered,
+// page-aligned staging buffers. A write is cut into slot-sized chunks that are copied in and submitted
+// with WRITE_FIXED, so copying the next chunk overlaps the device writing the previous ones.
+class IoRing {
+public:
+    ~IoRing() {
+        if (ringFd < 0) return;
+        munmap(staging, IO_RING_SLOTS * IO_SLOT_BYTES);
+        munmap(sqes, sqeBytes);
+        if (cqRing != sqRing) munmap(cqRing, cqRingBytes);
+        munmap(sqRing, sqRingBytes);
+        close(ringFd);
+    }
+
+    bool init() {
+        io_uring_params params = {};
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, IO_RING_SLOTS, &params));
+        if (ringFd < 0) return false;
+
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) sqRingBytes = cqRingBytes = std::max(sqRingBytes, cqRingBytes);
+        sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+
+        sqRing = static_cast<uint8_t*>(mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING));
+        cqRing = singleMmap ? sqRing : static_cast<uint8_t*>(mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING));
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+        staging = static_cast<uint8_t*>(mmap(nullptr, IO_RING_SLOTS * IO_SLOT_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED || staging == MAP_FAILED) {
+            // Release the mappings that did succeed
+            if (staging != MAP_FAILED) munmap(staging, IO_RING_SLOTS * IO_SLOT_BYTES);
+            if (sqes != MAP_FAILED) munmap(sqes, sqeBytes);
+            if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+            if (sqRing != MAP_FAILED) munmap(sqRing, sqRingBytes);
+            close(ringFd);
+            ringFd = -1;
+            return false;
+        }
+
+        sqTail = reinterpret_cast<unsigned*>(sqRing + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sqRing + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sqRing + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cqRing + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cqRing + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cqRing + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+
+        // Pin the staging buffers once instead of on every write
+        iovec buffers[IO_RING_SLOTS];
+        for (int slot = 0; slot < IO_RING_SLOTS; slot++) {
+            buffers[slot].iov_base = staging + slot * IO_SLOT_BYTES;
+            buffers[slot].iov_len = IO_SLOT_BYTES;
+            freeSlots.push_back(slot);
+        }
+        return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers, IO_RING_SLOTS) == 0;
+    }
+
+    // Write a whole buffer at a file offset and wait for it. With O_DIRECT files the last chunk is
+    // zero-padded to 4 KiB; the caller truncates the file back to its real size.
+    bool write(int fd, const uint8_t* data, size_t size, uint64_t offset, bool direct) {
+        bool ok = true;
+        while (size > 0) {
+            if (freeSlots.empty()) ok = reap(1) && ok;
+            if (freeSlots.empty()) {
+                reap(inFlight);
+                return false;
+            }
+            int slot = freeSlots.back();
+            freeSlots.pop_back();
+
+            size_t chunk = std::min(size, IO_SLOT_BYTES);
+            size_t length = direct ? (chunk + 4095) & ~static_cast<size_t>(4095) : chunk;
+            uint8_t* buffer = staging + slot * IO_SLOT_BYTES;
+            std::memcpy(buffer, data, chunk);
+            std::memset(buffer + chunk, 0, length - chunk);
+
+            unsigned tail = *sqTail;
+            unsigned index = tail & sqMask;
+            io_uring_sqe& sqe = sqes[index];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITE_FIXED;
+            sqe.fd = fd;
+            sqe.off = offset;
+            sqe.addr = reinterpret_cast<uint64_t>(buffer);
+            sqe.len = static_cast<uint32_t>(length);
+            sqe.buf_index = static_cast<uint16_t>(slot);
+            sqe.user_data = (static_cast<uint64_t>(length) << 8) | slot;
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            if (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0) != 1) {
+                // Not submitted: take the entry back and recycle its slot, then drain the writes in flight
+                // so the ring is left idle for the next file
+                __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+                freeSlots.push_back(slot);
+                reap(inFlight);
+                return false;
+            }
+            inFlight++;
+
+            data += chunk;
+            size -= chunk;
+            offset += chunk;
+        }
+        return reap(inFlight) && ok;
+    }
+
+private:
+    // Wait for `count` completions and recycle their slots
+    bool reap(int count) {
+        bool ok = true;
+        while (count > 0) {
+            unsigned head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                long entered = syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (entered < 0 && errno != EINTR) return false;
+                continue;
+            }
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            // Short or failed writes are not retried; the frame is reported as not written
+            if (cqe.res < 0 || static_cast<uint64_t>(cqe.res) != (cqe.user_data >> 8)) ok = false;
+            freeSlots.push_back(static_cast<int>(cqe.user_data & 0xff));
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            inFlight--;
+            count--;
+        }
+        return ok;
+    }
+
+    int ringFd = -1;
+    uint8_t* sqRing = nullptr;
+    uint8_t* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    uint8_t* staging = nullptr;
+    size_t sqRingBytes = 0, cqRingBytes = 0, sqeBytes = 0;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    std::vector<int> freeSlots;
+    int inFlight = 0;
+};
+
+// The calling thread's ring, or nullptr when io_uring is off or unavailable (old kernel, seccomp)
+IoRing* threadIoRing() {
+    if (fileIo != FileIo::Uring) return nullptr;
+    thread_local std::unique_ptr<IoRing> ring;
+    thread_local bool failed = false;
+    if (!ring && !failed) {
+        ring.reset(new IoRing());
+        if (!ring->init()) {
+            ring.reset();
+            failed = true;
+            static std::once_flag warned;
+            std::call_once(warned, [] { std::cerr << "io_uring unavailable, using blocking writes" << std::endl; });
+        }
+    }
+    return ring.get();
+}
+#endif
+
+// Write a buffer at an offset of an open file through io_uring when enabled, pwrite otherwise
+bool writeFileAt(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+#ifdef FRACTAL_IO_URING
+    if (IoRing* ring = threadIoRing()) return ring->write(fd, data, size, offset, false);
+#endif
+    return writeAllAt(fd, data, size, offset);
+}
+
+// Write an encoded frame to a file in one go, flushed to the device first when `sync` is set
+bool writeFileBytes(const char* path, const uint8_t* data, size_t size, bool sync = false) {
+#ifdef FRACTAL_IO_URING
+    if (IoRing* ring = threadIoRing()) {
+        // O_DIRECT skips the page cache for huge frames; not every filesystem supports it (tmpfs)
+        int fd = directIo ? ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644) : -1;
+        bool direct = fd >= 0;
+        if (!direct) fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool written = ring->write(fd, data, size, 0, direct);
+        if (direct) written = ftruncate(fd, static_cast<off_t>(size)) == 0 && written;
+        if (sync) written = fsync(fd) == 0 && written;
+        return close(fd) == 0 && written;
+    }
+#endif
+    // A plain descriptor rather than an ofstream, which allocates its buffer for every file
+#ifdef _WIN32
+    int fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0) return false;
+    bool written = writeAll(fd, data, size);
+#ifdef _WIN32
+    if (sync) written = _commit(fd) == 0 && written;
+    return _close(fd) == 0 && written;
+#else
+    if (sync) written = fsync(fd) == 0 && written;
+    return close(fd) == 0 && written;
+#endif
+}
+
+// RGBA -> RGB, dropping alpha
+void convertRgbaToRgb(const sf::Uint8* rgba, uint8_t* rgb, size_t pixelCount) {
+    size_t i = 0;
+#if defined(FRACTAL_SSSE3)
+    // 16 pixels in, 48 bytes out per step: four shuffles packed with byte shifts
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    for (; i + 16 <= pixelCount; i += 16) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4)), pack);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4 + 16)), pack);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4 + 32)), pack);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4 + 48)), pack);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgb + i * 3), _mm_or_si128(a, _mm_slli_si128(b, 12)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgb + i * 3 + 16), _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgb + i * 3 + 32), _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+    }
+#elif defined(FRACTAL_NEON)
+    for (; i + 16 <= pixelCount; i += 16) {
+        uint8x16x4_t in = vld4q_u8(rgba + i * 4);
+        uint8x16x3_t out = { { in.val[0], in.val[1], in.val[2] } };
+        vst3q_u8(rgb + i * 3, out);
+    }
+#endif
+    for (; i < pixelCount; i++) {
+        rgb[i * 3] = rgba[i * 4];
+        rgb[i * 3 + 1] = rgba[i * 4 + 1];
+        rgb[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+}
+
+// RGBA -> BGRA
+void convertRgbaToBgra(const sf::Uint8* rgba, uint8_t* bgra, size_t pixelCount) {
+    size_t i = 0;
+#if defined(FRACTAL_SSSE3)
+    const __m128i swap = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + i * 4), _mm_shuffle_epi8(in, swap));
+    }
+#elif defined(FRACTAL_NEON)
+    for (; i + 16 <= pixelCount; i += 16) {
+        uint8x16x4_t in = vld4q_u8(rgba + i * 4);
+        uint8x16x4_t out = { { in.val[2], in.val[1], in.val[0], in.val[3] } };
+        vst4q_u8(bgra + i * 4, out);
+    }
+#endif
+    for (; i < pixelCount; i++) {
+        bgra[i * 4] = rgba[i * 4 + 2];
+        bgra[i * 4 + 1] = rgba[i * 4 + 1];
+        bgra[i * 4 + 2] = rgba[i * 4];
+        bgra[i * 4 + 3] = rgba[i * 4 + 3];
+    }
+}
+
+// Binary PPM (P6): text header plus raw RGB
+bool encodePpm(const sf::Uint8* pixels, int width, int height, std::vector<uint8_t>& out) {
+    char header[64];
+    int headerBytes = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    out.insert(out.end(), header, header + headerBytes);
+    size_t start = out.size();
+    out.resize(start + static_cast<size_t>(width) * height * 3);
+    convertRgbaToRgb(pixels, out.data() + start, static_cast<size_t>(width) * height);
+    return true;
+}
+
+// PAM (P7): the RGBA buffer as is
+bool encodePam(const sf::Uint8* pixels, int width, int height, std::vector<uint8_t>& out) {
+    char header[128];
+    int headerBytes = std::snprintf(header, sizeof(header),
+        "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+    out.insert(out.end(), header, header + headerBytes);
+    out.insert(out.end(), pixels, pixels + static_cast<size_t>(width) * height * 4);
+    return true;
+}
+
+// Uncompressed 32-bit TGA, top-left origin
+bool encodeTga(const sf::Uint8* pixels, int width, int height, std::vector<uint8_t>& out) {
+    uint8_t header[18] = {};
+    header[2] = 2; // uncompressed true-color
+    header[12] = static_cast<uint8_t>(width);
+    header[13] = static_cast<uint8_t>(width >> 8);
+    header[14] = static_cast<uint8_t>(height);
+    header[15] = static_cast<uint8_t>(height >> 8);
+    header[16] = 32;
+    header[17] = 0x28; // 8 alpha bits, rows stored top to bottom
+    out.insert(out.end(), header, header + sizeof(header));
+    size_t start = out.size();
+    out.resize(start + static_cast<size_t>(width) * height * 4);
+    convertRgbaToBgra(pixels, out.data() + start, static_cast<size_t>(width) * height);
+    return true;
+}
+
+// QOI ("Quite OK Image") encoder, following the reference specification
+bool encodeQoi(const sf::Uint8* pixels, int width, int height, std::vector<uint8_t>& out) {
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    out.reserve(out.size() + 14 + pixelCount * 5 + 8);
+
+    const uint8_t header[14] = {
+        'q', 'o', 'i', 'f',
+        static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16), static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+        static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16), static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+        4, 0, // RGBA, sRGB
+    };
+    out.insert(out.end(), header, header + 14);
+
+    uint32_t index[64] = {};
+    uint8_t previous[4] = { 0, 0, 0, 255 };
+    int run = 0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        const uint8_t* px = pixels + i * 4;
+        if (std::memcmp(px, previous, 4) == 0) {
+            run++;
+            if (run == 62 || i + 1 == pixelCount) {
+                out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+            run = 0;
+        }
+
+        uint32_t value;
+        std::memcpy(&value, px, 4);
+        int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if (index[hash] == value) {
+            out.push_back(static_cast<uint8_t>(hash));
+        }
+        else {
+            index[hash] = value;
+            if (px[3] == previous[3]) {
+                int8_t dr = static_cast<int8_t>(px[0] - previous[0]);
+                int8_t dg = static_cast<int8_t>(px[1] - previous[1]);
+                int8_t db = static_cast<int8_t>(px[2] - previous[2]);
+                int drg = dr - dg, dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if (drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7) {
+                    out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                    out.push_back(static_cast<uint8_t>((drg + 8) << 4 | (dbg + 8)));
+                }
+                else {
+                    out.push_back(0xFE);
+                    out.insert(out.end(), px, px + 3);
+                }
+            }
+            else {
+                out.push_back(0xFF);
+                out.insert(out.end(), px, px + 4);
+            }
+        }
+        std::memcpy(previous, px, 4);
+    }
+
+    const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out.insert(out.end(), end, end + 8);
+    return true;
+}
+
+// Append a PNG chunk: length, type, data and CRC of type + data
+void appendPngChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t length) {
+    uint8_t header[8] = {
+        static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+        static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length),
+        static_cast<uint8_t>(type[0]), static_cast<uint8_t>(type[1]),
+        static_cast<uint8_t>(type[2]), static_cast<uint8_t>(type[3]),
+    };
+    uLong crc = crc32(0, header + 4, 4);
+    if (length > 0) crc = crc32(crc, data, static_cast<uInt>(length));
+
+    out.insert(out.end(), header, header + 8);
+    if (length > 0) out.insert(out.end(), data, data + length);
+    uint8_t trailer[4] = {
+        static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+        static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc),
+    };
+    out.insert(out.end(), trailer, trailer + 4);
+}
+
+// PNG Paeth predictor
+inline int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+// Filter one RGBA row to RGB, choosing the PNG filter with the smallest sum of absolute residuals.
+// `previous` is the row above (nullptr for the first row); `out` receives the filter byte plus 3 * width bytes.
+void filterPngRow(const sf::Uint8* row, const sf::Uint8* previous, int width, uint8_t* out, std::vector<uint8_t>& scratch) {
+    const size_t rowBytes = static_cast<size_t>(width) * 3;
+    scratch.resize(rowBytes * 5);
+
+    // Strip alpha (frames are always opaque), predicting each byte from its left / up / up-left neighbours
+    for (int x = 0; x < width; x++) {
+        for (int c = 0; c < 3; c++) {
+            int raw = row[x * 4 + c];
+            int left = x > 0 ? row[(x - 1) * 4 + c] : 0;
+            int up = previous ? previous[x * 4 + c] : 0;
+            int upLeft = previous && x > 0 ? previous[(x - 1) * 4 + c] : 0;
+            size_t i = x * 3 + c;
+            scratch[i] = static_cast<uint8_t>(raw);
+            scratch[rowBytes + i] = static_cast<uint8_t>(raw - left);
+            scratch[rowBytes * 2 + i] = static_cast<uint8_t>(raw - up);
+            scratch[rowBytes * 3 + i] = static_cast<uint8_t>(raw - (left + up) / 2);
+            scratch[rowBytes * 4 + i] = static_cast<uint8_t>(raw - paeth(left, up, upLeft));
+        }
+    }
+
+    int bestFilter = 0;
+    uint64_t bestSum = UINT64_MAX;
+    for (int filter = 0; filter < (pngLevel == 0 ? 1 : 5); filter++) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < rowBytes; i++) {
+            sum += std::abs(static_cast<int8_t>(scratch[rowBytes * filter + i]));
+        }
+        if (sum < bestSum) {
+            bestSum = sum;
+            bestFilter = filter;
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(bestFilter);
+    std::memcpy(out + 1, scratch.data() + rowBytes * bestFilter, rowBytes);
+}
+
+// A band of rows filtered and deflated independently of the others
+struct PngChunk {
+    int firstRow = 0, lastRow = 0;
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> deflated;
+    uLong adler = 1;
+};
+
+// Encode an RGBA frame as an RGB PNG, filtering and deflating row bands in parallel on the render pool
+// (pigz-style: each band is primed with the previous band's last 32 KiB and sync-flushed, so the
+// pieces concatenate into one valid zlib stream whose Adler-32 is combined from the band checksums).
+// Both passes are urgent, so an encoder thread never waits behind the frames queued for rendering.
+// The bands and jobs are kept per encoding thread, so a warm encoder reuses their buffers.
+bool encodePng(const sf::Uint8* pixels, int width, int height, std::vector<uint8_t>& out) {
+    const size_t filteredRowBytes = static_cast<size_t>(width) * 3 + 1;
+    const int rowsPerChunk = std::max<int>(1, static_cast<int>(PNG_CHUNK_BYTES / filteredRowBytes));
+    const int chunkCount = (height + rowsPerChunk - 1) / rowsPerChunk;
+
+    thread_local std::vector<PngChunk> chunkBuffer;
+    thread_local RenderJob filterJob, deflateJob;
+    if (chunkBuffer.size() < static_cast<size_t>(chunkCount)) chunkBuffer.resize(chunkCount);
+    PngChunk* const chunks = chunkBuffer.data();
+    for (int i = 0; i < chunkCount; i++) {
+        chunks[i].firstRow = i * rowsPerChunk;
+        chunks[i].lastRow = std::min(height, chunks[i].firstRow + rowsPerChunk);
+    }
+    auto anyNode = [](int) { return 0; };
+
+    // What the pool's units read, gathered so their lambdas capture a single reference
+    struct {
+        const sf::Uint8* pixels;
+        int width;
+        size_t filteredRowBytes;
+        PngChunk* chunks;
+        int chunkCount;
+        std::atomic<bool> failed;
+    } encode{ pixels, width, filteredRowBytes, chunks, chunkCount, { false } };
+
+    // Pass 1: filter every band (each row only needs the raw row above it)
+    renderPool.submit(filterJob, chunkCount, anyNode, [&encode](int i, int) {
+        thread_local std::vector<uint8_t> scratch;
+        const sf::Uint8* pixels = encode.pixels;
+        const int width = encode.width;
+        const size_t filteredRowBytes = encode.filteredRowBytes;
+        PngChunk& chunk = encode.chunks[i];
+        chunk.filtered.resize((chunk.lastRow - chunk.firstRow) * filteredRowBytes);
+        for (int y = chunk.firstRow; y < chunk.lastRow; y++) {
+            const sf::Uint8* row = pixels + static_cast<size_t>(y) * width * 4;
+            const sf::Uint8* previous = y > 0 ? row - static_cast<size_t>(width) * 4 : nullptr;
+            filterPngRow(row, previous, width, chunk.filtered.data() + (y - chunk.firstRow) * filteredRowBytes, scratch);
+        }
+        chunk.adler = adler32(1, chunk.filtered.data(), static_cast<uInt>(chunk.filtered.size()));
+    }, true);
+    renderPool.wait(filterJob);
+
+    // Pass 2: deflate every band as a raw stream, primed with the tail of the band before it
+    renderPool.submit(deflateJob, chunkCount, anyNode, [&encode](int i, int) {
+        PngChunk& chunk = encode.chunks[i];
+        z_stream stream = {};
+        if (deflateInit2(&stream, pngLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            encode.failed = true;
+            return;
+        }
+        if (i > 0) {
+            const std::vector<uint8_t>& dictionary = encode.chunks[i - 1].filtered;
+            size_t dictionaryBytes = std::min<size_t>(dictionary.size(), 32768);
+            deflateSetDictionary(&stream, dictionary.data() + dictionary.size() - dictionaryBytes, static_cast<uInt>(dictionaryBytes));
+        }
+
+        chunk.deflated.resize(deflateBound(&stream, static_cast<uLong>(chunk.filtered.size())) + 16);
+        stream.next_in = chunk.filtered.data();
+        stream.avail_in = static_cast<uInt>(chunk.filtered.size());
+        stream.next_out = chunk.deflated.data();
+        stream.avail_out = static_cast<uInt>(chunk.deflated.size());
+
+        // Sync-flushed bands end byte-aligned without the final-block bit; only the last band finishes the stream
+        bool last = i + 1 == encode.chunkCount;
+        int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (result != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) encode.failed = true;
+        chunk.deflated.resize(stream.total_out);
+        deflateEnd(&stream);
+    }, true);
+    renderPool.wait(deflateJob);
+    if (encode.failed) return false;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t header[13] = {
+        static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16), static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+        static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16), static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+        8, 2, 0, 0, 0, // 8-bit RGB, deflate, adaptive filtering, no interlace
+    };
+    out.insert(out.end(), signature, signature + 8);
+    appendPngChunk(out, "IHDR", header, sizeof(header));
+
+    // Stitch one IDAT in place: zlib header, the bands in order, then the combined Adler-32
+    int levelFlag = pngLevel < 2 ? 0 : pngLevel < 6 ? 1 : pngLevel == 6 ? 2 : 3;
+    uint8_t zlibHeader[2] = { 0x78, static_cast<uint8_t>(levelFlag << 6) };
+    zlibHeader[1] += 31 - (zlibHeader[0] * 256 + zlibHeader[1]) % 31;
+
+    size_t idatLength = 2 + 4;
+    for (int i = 0; i < chunkCount; i++) {
+        idatLength += chunks[i].deflated.size();
+    }
+    uint8_t idatHeader[8] = {
+        static_cast<uint8_t>(idatLength >> 24), static_cast<uint8_t>(idatLength >> 16),
+        static_cast<uint8_t>(idatLength >> 8), static_cast<uint8_t>(idatLength), 'I', 'D', 'A', 'T',
+    };
+    out.insert(out.end(), idatHeader, idatHeader + 8);
+    size_t idatStart = out.size() - 4; // the CRC covers the chunk type and data
+
+    out.insert(out.end(), zlibHeader, zlibHeader + 2);
+    uLong adler = 1;
+    for (int i = 0; i < chunkCount; i++) {
+        out.insert(out.end(), chunks[i].deflated.begin(), chunks[i].deflated.end());
+        adler = adler32_combine(adler, chunks[i].adler, static_cast<z_off_t>(chunks[i].filtered.size()));
+    }
+    uint8_t adlerBytes[4] = {
+        static_cast<uint8_t>(adler >> 24), static_cast<uint8_t>(adler >> 16),
+        static_cast<uint8_t>(adler >> 8), static_cast<uint8_t>(adler),
+    };
+    out.insert(out.end(), adlerBytes, adlerBytes + 4);
+
+    uLong crc = crc32(0, out.data() + idatStart, static_cast<uInt>(out.size() - idatStart));
+    uint8_t crcBytes[4] = {
+        static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+        static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc),
+    };
+    out.insert(out.end(), crcBytes, crcBytes + 4);
+
+    appendPngChunk(out, "IEND", nullptr, 0);
+    return true;
+}
+
+// Encode a frame in the selected output format, appending to `out`
+bool encodeFrame(const sf::Uint8* pixels, int width, int height, std::vector<uint8_t>& out) {
+    switch (frameFormat) {
+    case FrameFormat::Png: return encodePng(pixels, width, height, out);
+    case FrameFormat::Qoi: return encodeQoi(pixels, width, height, out);
+    case FrameFormat::Ppm: return encodePpm(pixels, width, height, out);
+    case FrameFormat::Pam: return encodePam(pixels, width, height, out);
+    case FrameFormat::Tga: return encodeTga(pixels, width, height, out);
+    }
+    return false;
+}
+
+// Little-endian fields of the archive format
+inline void putLittleEndian(uint8_t* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline uint64_t getLittleEndian(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+// All frames of a run in one file instead of thousands of small ones.
+//   header  "FRAMEARC", u32 version, u32 payload format
+//   record  "FRME", u32 frame, u64 size, u32 crc32, encoded frame      (repeated, appended as frames finish)
+//   index   "FIDX", u32 count, count x (u32 frame, u64 offset, u64 size, u32 crc32)
+//   footer  u64 index offset, "FEND"
+// The index and footer are only written on close. An archive without them (after a crash) is recovered
+// by scanning the records and cutting the file back to the last complete one, so resumed runs can append.
+// A re-rendered frame is appended again and the index points at the newest record; once superseded records
+// reach ARCHIVE_COMPACT_FRACTION of the file, close() copies the live ones into a fresh archive instead.
+class FrameArchive {
+public:
+    struct Entry {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t crc;
+    };
+
+    ~FrameArchive() {
+        close();
+    }
+
+    // Create an archive, or reopen an existing one for appending
+    bool open(const std::string& archivePath, FrameFormat payloadFormat) {
+        path = archivePath;
+        format = payloadFormat;
+        std::error_code error;
+        if (std::filesystem::exists(path, error)) {
+            FrameFormat existingFormat;
+            if (!loadIndex(path, index, existingFormat, dataEnd)) {
+                std::cerr << path << " is not a frame archive" << std::endl;
+                return false;
+            }
+            if (existingFormat != payloadFormat) {
+                std::cerr << path << " holds frames in a different format" << std::endl;
+                return false;
+            }
+            std::filesystem::resize_file(path, dataEnd, error); // drop the old index (or a torn record)
+            if (error) return false;
+            deadBytes = dataEnd - 16;
+            for (const auto& entry : index) deadBytes -= 20 + entry.second.size;
+        }
+        else {
+            uint8_t header[16];
+            putHeader(header, payloadFormat);
+            if (!writeFileBytes(path.c_str(), header, sizeof(header))) return false;
+            dataEnd = sizeof(header);
+        }
+
+        // Read back as well when compacting
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+#else
+        fd = ::open(path.c_str(), O_RDWR);
+#endif
+        return fd >= 0;
+    }
+
+    bool contains(int frameNumber) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index.count(frameNumber) > 0;
+    }
+
+    // Append one encoded frame; safe to call from several encoder threads. A frame identical to the
+    // archive's newest record of it (re-rendered from the same state) is not appended again.
+    bool append(int frameNumber, const uint8_t* data, size_t size) {
+        uint8_t header[20] = { 'F', 'R', 'M', 'E' };
+        uint32_t crc = static_cast<uint32_t>(crc32(0, data, static_cast<uInt>(size)));
+        putLittleEndian(header + 4, static_cast<uint32_t>(frameNumber), 4);
+        putLittleEndian(header + 8, size, 8);
+        putLittleEndian(header + 16, crc, 4);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(frameNumber);
+        if (found != index.end() && found->second.size == size && found->second.crc == crc) {
+            thread_local std::vector<uint8_t> stored;
+            stored.resize(size);
+            if (readAllAt(fd, stored.data(), size, found->second.offset) && std::memcmp(stored.data(), data, size) == 0) {
+                return true;
+            }
+        }
+        if (!writeFileAt(fd, header, sizeof(header), dataEnd) || !writeFileAt(fd, data, size, dataEnd + sizeof(header))) {
+            return false;
+        }
+
+        if (found != index.end()) deadBytes += sizeof(header) + found->second.size;
+        index[frameNumber] = Entry{ dataEnd + sizeof(header), size, crc };
+        dataEnd += sizeof(header) + size;
+        return true;
+    }
+
+    // Write the index and footer and flush the archive to the device, compacting it first when enough of
+    // it is superseded records. False, after reporting why, if the archive could not be completed.
+    bool close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) return true;
+
+        bool compacted = deadBytes > 0 && deadBytes >= ARCHIVE_COMPACT_FRACTION * dataEnd && compact();
+        bool ok = compacted || (writeTail(fd, index, dataEnd) && syncFile(fd));
+        ok = closeFile(fd) && ok;
+        fd = -1;
+        if (!ok) std::cerr << "Failed to finish archive " << path << ": " << std::strerror(errno) << std::endl;
+        return ok;
+    }
+
+    // Random access: read one frame's encoded bytes by frame number
+    static bool readFrame(const std::string& archivePath, int frameNumber, std::vector<uint8_t>& data, FrameFormat& format) {
+        std::map<int, Entry> entries;
+        uint64_t end;
+        if (!loadIndex(archivePath, entries, format, end)) return false;
+        auto found = entries.find(frameNumber);
+        if (found == entries.end()) return false;
+
+        std::ifstream in(archivePath, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(found->second.offset));
+        data.resize(found->second.size);
+        in.read(reinterpret_cast<char*>(data.data()), data.size());
+        return in && crc32(0, data.data(), static_cast<uInt>(data.size())) == found->second.crc;
+    }
+
+private:
+    static void putHeader(uint8_t* header, FrameFormat payloadFormat) {
+        std::memcpy(header, "FRAMEARC", 8);
+        putLittleEndian(header + 8, 1, 4);
+        putLittleEndian(header + 12, static_cast<uint32_t>(payloadFormat), 4);
+    }
+
+    static bool writeTail(int file, const std::map<int, Entry>& entries, uint64_t end) {
+        std::vector<uint8_t> tail(8 + entries.size() * 24 + 12);
+        std::memcpy(tail.data(), "FIDX", 4);
+        putLittleEndian(tail.data() + 4, entries.size(), 4);
+        size_t position = 8;
+        for (const auto& entry : entries) {
+            putLittleEndian(tail.data() + position, static_cast<uint32_t>(entry.first), 4);
+            putLittleEndian(tail.data() + position + 4, entry.second.offset, 8);
+            putLittleEndian(tail.data() + position + 12, entry.second.size, 8);
+            putLittleEndian(tail.data() + position + 20, entry.second.crc, 4);
+            position += 24;
+        }
+        putLittleEndian(tail.data() + position, end, 8);
+        std::memcpy(tail.data() + position + 8, "FEND", 4);
+        return writeAllAt(file, tail.data(), tail.size(), end);
+    }
+
+    static bool syncFile(int file) {
+#ifdef _WIN32
+        return _commit(file) == 0;
+#else
+        return fsync(file) == 0;
+#endif
+    }
+
+    static bool closeFile(int file) {
+#ifdef _WIN32
+        return _close(file) == 0;
+#else
+        return ::close(file) == 0;
+#endif
+    }
+
+    // Copy the newest record of every frame, in frame order, into a fresh archive beside this one and
+    // rename it over this one. On failure this archive is left as it was, and close() finishes it instead.
+    bool compact() {
+        std::string compactedPath = path + ".partial";
+#ifdef _WIN32
+        int out = _open(compactedPath.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+        int out = ::open(compactedPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (out < 0) return false;
+
+        uint8_t header[16];
+        putHeader(header, format);
+        bool ok = writeAllAt(out, header, sizeof(header), 0);
+        std::map<int, Entry> entries;
+        uint64_t end = sizeof(header);
+        std::vector<uint8_t> record;
+        for (const auto& entry : index) {
+            if (!ok) break;
+            record.resize(20 + entry.second.size);
+            ok = readAllAt(fd, record.data(), record.size(), entry.second.offset - 20) &&
+                writeAllAt(out, record.data(), record.size(), end);
+            entries[entry.first] = Entry{ end + 20, entry.second.size, entry.second.crc };
+            end += record.size();
+        }
+        ok = ok && writeTail(out, entries, end) && syncFile(out);
+        ok = closeFile(out) && ok;
+        if (!ok || std::rename(compactedPath.c_str(), path.c_str()) != 0) {
+            std::remove(compactedPath.c_str());
+            return false;
+        }
+
+        std::cout << "Archive compacted: " << path << " " << (dataEnd - 16) / 1024 << " -> " << (end - 16) / 1024
+            << " KiB of records" << std::endl;
+        index.swap(entries);
+        dataEnd = end;
+        deadBytes = 0;
+        return true;
+    }
+
+    // Read the index from the footer, or rebuild it by scanning records if the archive was not closed
+    static bool loadIndex(const std::string& archivePath, std::map<int, Entry>& entries, FrameFormat& format, uint64_t& end) {
+        std::ifstream in(archivePath, std::ios::binary);
+        uint8_t header[20];
+        if (!in.read(reinterpret_cast<char*>(header), 16) || std::memcmp(header, "FRAMEARC", 8) != 0) return false;
+        format = static_cast<FrameFormat>(getLittleEndian(header + 12, 4));
+
+        in.seekg(0, std::ios::end);
+        uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+        entries.clear();
+
+        if (fileSize >= 16 + 8 + 12) {
+            uint8_t footer[12];
+            in.seekg(static_cast<std::streamoff>(fileSize - 12));
+            in.read(reinterpret_cast<char*>(footer), 12);
+            uint64_t indexOffset = getLittleEndian(footer, 8);
+
+            uint8_t indexHeader[8];
+            if (in && std::memcmp(footer + 8, "FEND", 4) == 0 && indexOffset >= 16 && indexOffset + 8 + 12 <= fileSize &&
+                in.seekg(static_cast<std::streamoff>(indexOffset)) && in.read(reinterpret_cast<char*>(indexHeader), 8) &&
+                std::memcmp(indexHeader, "FIDX", 4) == 0 &&
+                indexOffset + 8 + getLittleEndian(indexHeader + 4, 4) * 24 + 12 == fileSize) {
+                std::vector<uint8_t> table(getLittleEndian(indexHeader + 4, 4) * 24);
+                in.read(reinterpret_cast<char*>(table.data()), table.size());
+                for (size_t i = 0; i < table.size(); i += 24) {
+                    entries[static_cast<int>(getLittleEndian(&table[i], 4))] = Entry{
+                        getLittleEndian(&table[i + 4], 8), getLittleEndian(&table[i + 12], 8),
+                        static_cast<uint32_t>(getLittleEndian(&table[i + 20], 4)) };
+                }
+                end = indexOffset;
+                return static_cast<bool>(in);
+            }
+            in.clear();
+        }
+
+        // No valid index: keep every record that is complete and intact, stop at the first that is not
+        std::vector<uint8_t> payload;
+        uint64_t position = 16;
+        while (position + 20 <= fileSize) {
+            in.seekg(static_cast<std::streamoff>(position));
+            if (!in.read(reinterpret_cast<char*>(header), 20) || std::memcmp(header, "FRME", 4) != 0) break;
+            uint64_t size = getLittleEndian(header + 8, 8);
+            if (position + 20 + size > fileSize) break;
+            payload.resize(size);
+            if (!in.read(reinterpret_cast<char*>(payload.data()), size)) break;
+            uint32_t crc = static_cast<uint32_t>(getLittleEndian(header + 16, 4));
+            if (crc32(0, payload.data(), static_cast<uInt>(size)) != crc) break;
+
+            entries[static_cast<int>(getLittleEndian(header + 4, 4))] = Entry{ position + 20, size, crc };
+            position += 20 + size;
+        }
+        end = position;
+        return true;
+    }
+
+    std::string path;
+    FrameFormat format = FrameFormat::Png;
+    int fd = -1;
+    std::map<int, Entry> index;
+    uint64_t dataEnd = 0;
+    uint64_t deadBytes = 0; // records superseded by a newer one of the same frame
+    std::mutex mutex;
+};
+
+// When set, saved frames are appended to this archive instead of written as separate files
+FrameArchive* frameArchive = nullptr;
+
+// Canonical 64-bit FNV-1a hash of everything that determines a frame's pixels: the engine version,
+// the output size and every RenderState field, each in a fixed width and byte order
+uint64_t hashFrame(const RenderState& state, int width, int height) {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    auto addDouble = [&](double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        add(bits);
+    };
+
+    add(ENGINE_VERSION);
+    add(static_cast<uint64_t>(width));
+    add(static_cast<uint64_t>(height));
+    addDouble(state.viewportX);
+    addDouble(state.viewportY);
+    addDouble(state.viewportHeight);
+    add(static_cast<uint64_t>(state.maxIterations));
+    addDouble(state.colorDensity);
+    add(state.showJulia);
+    addDouble(state.juliaX);
+    addDouble(state.juliaY);
+    add(static_cast<uint64_t>(state.colorScheme));
+    add(state.autoIterations);
+    add(static_cast<uint64_t>(state.fractalType));
+    add(state.stripes);
+    addDouble(state.stripeFrequency);
+    addDouble(state.stripeIntensity);
+    add(state.innerCalculation);
+    add(state.antiAliasing);
+    add(state.histogramColoring);
+    addDouble(state.aspectRatio);
+    add(expMapRenderer != nullptr); // warped or resampled frames differ slightly from directly rendered ones
+    add(keyframeRenderer != nullptr);
+    if (supersample > 1) {
+        add(static_cast<uint64_t>(supersample));
+        add(static_cast<uint64_t>(resampleFilter));
+    }
+    return hash;
+}
+
+// Sidecar index of the hash each saved frame was rendered from, one "frame hash" line per save (later
+// lines win). A rerun skips frames whose output exists and whose hash still matches, so only the frames
+// that changed are rendered again. A hash is recorded only after its frame is safely on disk.
+class FrameCache {
+public:
+    bool open(const std::string& indexPath) {
+        path = indexPath;
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            int frameNumber;
+            std::string hex;
+            if (fields >> frameNumber >> hex && hex.size() == 16) {
+                hashes[frameNumber] = std::strtoull(hex.c_str(), nullptr, 16);
+            }
+        }
+        in.close();
+
+        // Rewrite without superseded lines, then keep appending
+        std::string compacted = path + ".partial";
+        {
+            std::ofstream out(compacted);
+            for (const auto& entry : hashes) writeLine(out, entry.first, entry.second);
+            if (!out) return false;
+        }
+        if (std::rename(compacted.c_str(), path.c_str()) != 0) return false;
+        file.open(path, std::ios::app);
+        return file.is_open();
+    }
+
+    // True if the frame's output was saved from a state with this hash
+    bool matches(int frameNumber, uint64_t hash) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = hashes.find(frameNumber);
+        return found != hashes.end() && found->second == hash;
+    }
+
+    // The hash a frame is being rendered from, recorded once it is saved.
+    // A frame's map node moves between the two maps, so re-rendering a known frame allocates nothing.
+    void expect(int frameNumber, uint64_t hash) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto node = hashes.extract(frameNumber);
+        if (node.empty()) {
+            pending[frameNumber] = hash;
+            return;
+        }
+        node.mapped() = hash;
+        auto inserted = pending.insert(std::move(node));
+        if (!inserted.inserted) inserted.position->second = hash;
+    }
+
+    void saved(int frameNumber) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto node = pending.extract(frameNumber);
+        if (node.empty()) return;
+        writeLine(file, frameNumber, node.mapped());
+        file.flush();
+        hashes.insert(std::move(node));
+    }
+
+private:
+    static void writeLine(std::ostream& out, int frameNumber, uint64_t hash) {
+        out << frameNumber << ' ' << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << '\n';
+    }
+
+    std::string path;
+    std::ofstream file;
+    std::map<int, uint64_t> hashes;
+    std::map<int, uint64_t> pending;
+    std::mutex mutex;
+};
+
+// When set, saved frames record the hash they were rendered from
+FrameCache* frameCache = nullptr;
+
+// Save a frame straight from its CPU pixel buffer in the selected format, without a window or texture.
+// It is written under a temporary name first, so a crash never leaves a truncated frame behind for resume to skip.
+void saveFrame(const sf::Uint8* pixels, int width, int height, int frameNumber) {
+    thread_local std::vector<uint8_t> encoded;
+    encoded.clear();
+    bool written = encodeFrame(pixels, width, height, encoded);
+
+    if (frameArchive) {
+        if (written && frameArchive->append(frameNumber, encoded.data(), encoded.size())) {
+            if (frameCache) frameCache->saved(frameNumber);
+            std::cout << "Frame archived: " << frameNumber << std::endl;
+        }
+        else {
+            std::cerr << "Failed to archive frame " << frameNumber << std::endl;
+        }
+        return;
+    }
+
+    char filename[64], partialName[64];
+    formatFrameFileName(filename, sizeof(filename), frameNumber);
+    formatFrameFileName(partialName, sizeof(partialName), frameNumber, ".partial");
+    written = written && writeFileBytes(partialName, encoded.data(), encoded.size());
+
+    if (written && std::rename(partialName, filename) == 0) {
+        if (frameCache) frameCache->saved(frameNumber);
+        std::cout << "Screenshot saved: " << filename << std::endl;
+    }
+    else {
+        std::cerr << "Failed to save " << filename << std::endl;
+    }
+}
+
+// Save screenshot with location info in filename
+void saveScreenshot(const sf::Texture& texture, const RenderState& state) {
+    sf::Image screenshot = texture.copyToImage();
+    sf::Vector2u size = screenshot.getSize();
+
+    time_t now = time(0);
+    tm timeinfo;
+
+#ifdef _WIN32
+    localtime_s(&timeinfo, &now);
+#else
+    tm* temp = localtime(&now);
+    if (temp) timeinfo = *temp;
+#endif
+
+    saveFrame(screenshot.getPixelsPtr(), size.x, size.y, frame);
+}
+
+// A finished frame copied out of its render slot, waiting for an encoder thread
+struct PendingFrame {
+    std::vector<sf::Uint8> pixels;
+    int width = 0, height = 0;
+    int frameNumber = 0;
+};
+
+// Encodes and saves frames on dedicated threads so PNG compression overlaps rendering.
+// Buffers are recycled through a fixed set; write() blocks while all of them are queued or encoding.
+class FrameWriter {
+public:
+    FrameWriter(int encoderThreads, int queueCapacity) {
+        buffers.resize(queueCapacity + encoderThreads);
+        queue.reserve(buffers.size());
+        for (PendingFrame& buffer : buffers) {
+            freeFrames.push_back(&buffer);
+        }
+        for (int i = 0; i < encoderThreads; i++) {
+            encoders.emplace_back(&FrameWriter::encoderLoop, this);
+        }
+    }
+
+    ~FrameWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        frameQueued.notify_all();
+        for (auto& encoder : encoders) {
+            encoder.join();
+        }
+    }
+
+    // Copy a frame into a free buffer and queue it (backpressure: waits for a free buffer)
+    void write(const sf::Uint8* pixels, int width, int height, int frameNumber) {
+        PendingFrame* pending;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameDone.wait(lock, [&]() { return !freeFrames.empty(); });
+            pending = freeFrames.back();
+            freeFrames.pop_back();
+        }
+
+        pending->pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+        pending->width = width;
+        pending->height = height;
+        pending->frameNumber = frameNumber;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(pending);
+        }
+        frameQueued.notify_one();
+    }
+
+    // Wait until every queued frame is on disk
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        frameDone.wait(lock, [&]() { return freeFrames.size() == buffers.size(); });
+    }
+
+private:
+    void encoderLoop() {
+        while (true) {
+            PendingFrame* pending;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frameQueued.wait(lock, [&]() { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                pending = queue.front();
+                queue.erase(queue.begin());
+            }
+
+            saveFrame(pending->pixels.data(), pending->width, pending->height, pending->frameNumber);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeFrames.push_back(pending);
+            }
+            frameDone.notify_all();
+        }
+    }
+
+    std::vector<PendingFrame> buffers;
+    std::vector<PendingFrame*> freeFrames;
+    std::vector<PendingFrame*> queue; // reserved for every buffer, so queuing never allocates
+    std::vector<std::thread> encoders;
+    std::mutex mutex;
+    std::condition_variable frameQueued;
+    std::condition_variable frameDone;
+    bool stopping = false;
+};
+
+// RGBA -> planar 4:2:0 BT.601 limited-range YUV. Chroma is taken from the average of each 2x2 block
+// (edge pixels repeat for odd sizes); planes are (width+1)/2 x (height+1)/2.
+void convertRgbaToYuv420(const sf::Uint8* rgba, int width, int height, uint8_t* yPlane, uint8_t* uPlane, uint8_t* vPlane) {
+    const int chromaWidth = (width + 1) / 2;
+
+    for (int y = 0; y < height; y++) {
+        const sf::Uint8* row = rgba + static_cast<size_t>(y) * width * 4;
+        uint8_t* yRow = yPlane + static_cast<size_t>(y) * width;
+        int x = 0;
+#if defined(FRACTAL_SSE2)
+        // 8 pixels per step: split the channels out of each 32-bit RGBA pixel, then 16-bit multiply-adds
+        const __m128i byteMask = _mm_set1_epi32(0xFF);
+        for (; x + 8 <= width; x += 8) {
+            __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+            __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4 + 16));
+            __m128i r = _mm_packs_epi32(_mm_and_si128(p0, byteMask), _mm_and_si128(p1, byteMask));
+            __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), byteMask), _mm_and_si128(_mm_srli_epi32(p1, 8), byteMask));
+            __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), byteMask), _mm_and_si128(_mm_srli_epi32(p1, 16), byteMask));
+            __m128i luma = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+                _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+            luma = _mm_add_epi16(_mm_srli_epi16(luma, 8), _mm_set1_epi16(16));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(yRow + x), _mm_packus_epi16(luma, luma));
+        }
+#elif defined(FRACTAL_NEON)
+        for (; x + 8 <= width; x += 8) {
+            uint8x8x4_t px = vld4_u8(row + x * 4);
+            uint16x8_t luma = vmull_u8(px.val[0], vdup_n_u8(66));
+            luma = vmlal_u8(luma, px.val[1], vdup_n_u8(129));
+            luma = vmlal_u8(luma, px.val[2], vdup_n_u8(25));
+            vst1_u8(yRow + x, vadd_u8(vrshrn_n_u16(luma, 8), vdup_n_u8(16)));
+        }
+#endif
+        for (; x < width; x++) {
+            const sf::Uint8* px = row + x * 4;
+            yRow[x] = static_cast<uint8_t>(((66 * px[0] + 129 * px[1] + 25 * px[2] + 128) >> 8) + 16);
+        }
+    }
+
+    for (int cy = 0; cy < (height + 1) / 2; cy++) {
+        const sf::Uint8* top = rgba + static_cast<size_t>(cy * 2) * width * 4;
+        const sf::Uint8* bottom = cy * 2 + 1 < height ? top + static_cast<size_t>(width) * 4 : top;
+        uint8_t* uRow = uPlane + static_cast<size_t>(cy) * chromaWidth;
+        uint8_t* vRow = vPlane + static_cast<size_t>(cy) * chromaWidth;
+        int cx = 0;
+#if defined(FRACTAL_SSE2)
+        // 4 chroma samples (8x2 pixels) per step: add the rows, then pair up columns with a multiply-add by one
+        const __m128i byteMask = _mm_set1_epi32(0xFF);
+        const __m128i ones = _mm_set1_epi16(1);
+        for (; cx * 2 + 8 <= width; cx += 4) {
+            __m128i sums[3];
+            for (int c = 0; c < 3; c++) {
+                __m128i t0 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + cx * 8)), c * 8), byteMask);
+                __m128i t1 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + cx * 8 + 16)), c * 8), byteMask);
+                __m128i b0 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + cx * 8)), c * 8), byteMask);
+                __m128i b1 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + cx * 8 + 16)), c * 8), byteMask);
+                __m128i columns = _mm_add_epi16(_mm_packs_epi32(t0, t1), _mm_packs_epi32(b0, b1));
+                __m128i blocks = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(columns, ones), _mm_set1_epi32(2)), 2);
+                sums[c] = _mm_packs_epi32(blocks, blocks); // average of the 2x2 block, 0-255
+            }
+            __m128i u = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(sums[0], _mm_set1_epi16(-38)), _mm_mullo_epi16(sums[1], _mm_set1_epi16(-74))),
+                _mm_add_epi16(_mm_mullo_epi16(sums[2], _mm_set1_epi16(112)), _mm_set1_epi16(128)));
+            __m128i v = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(sums[0], _mm_set1_epi16(112)), _mm_mullo_epi16(sums[1], _mm_set1_epi16(-94))),
+                _mm_add_epi16(_mm_mullo_epi16(sums[2], _mm_set1_epi16(-18)), _mm_set1_epi16(128)));
+            u = _mm_packus_epi16(_mm_add_epi16(_mm_srai_epi16(u, 8), _mm_set1_epi16(128)), _mm_setzero_si128());
+            v = _mm_packus_epi16(_mm_add_epi16(_mm_srai_epi16(v, 8), _mm_set1_epi16(128)), _mm_setzero_si128());
+            int uBytes = _mm_cvtsi128_si32(u), vBytes = _mm_cvtsi128_si32(v);
+            std::memcpy(uRow + cx, &uBytes, 4);
+            std::memcpy(vRow + cx, &vBytes, 4);
+        }
+#endif
+        for (; cx < chromaWidth; cx++) {
+            int x0 = cx * 2, x1 = std::min(cx * 2 + 1, width - 1);
+            int sum[3];
+            for (int c = 0; c < 3; c++) {
+                sum[c] = (top[x0 * 4 + c] + top[x1 * 4 + c] + bottom[x0 * 4 + c] + bottom[x1 * 4 + c] + 2) >> 2;
+            }
+            uRow[cx] = static_cast<uint8_t>(((-38 * sum[0] - 74 * sum[1] + 112 * sum[2] + 128) >> 8) + 128);
+            vRow[cx] = static_cast<uint8_t>(((112 * sum[0] - 94 * sum[1] - 18 * sum[2] + 128) >> 8) + 128);
+        }
+    }
+}
+
+enum class StreamFormat { None, Y4m, Rgba };
+
+// Streams frames, in order, to stdout or a named pipe for a video encoder: YUV4MPEG2 (4:2:0)
+// or headerless raw RGBA. Each frame goes out in one write; raw RGBA straight from the render buffer.
+class FrameStream {
+public:
+    ~FrameStream() {
+        if (fd > 2) {
+#ifdef _WIN32
+            _close(fd);
+#else
+            close(fd);
+#endif
+        }
+    }
+
+    bool open(const std::string& path, StreamFormat streamFormat, int frameWidth, int frameHeight, int fps) {
+        format = streamFormat;
+        width = frameWidth;
+        height = frameHeight;
+
+#ifdef _WIN32
+        if (path == "-") {
+            fd = 1;
+            _setmode(fd, _O_BINARY);
+        }
+        else {
+            fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+        }
+#else
+        signal(SIGPIPE, SIG_IGN); // A consumer that quits ends the animation instead of killing it
+        fd = path == "-" ? 1 : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd < 0) return false;
+
+        if (format == StreamFormat::Y4m) {
+            std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+                " F" + std::to_string(fps) + ":1 Ip A1:1 C420jpeg\n";
+            if (!writeAll(fd, reinterpret_cast<const uint8_t*>(header.data()), header.size())) return false;
+
+            // "FRAME\n" followed by the three planes, so a frame is one contiguous buffer
+            size_t lumaBytes = static_cast<size_t>(width) * height;
+            size_t chromaBytes = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+            frameBuffer.resize(6 + lumaBytes + chromaBytes * 2);
+            std::memcpy(frameBuffer.data(), "FRAME\n", 6);
+        }
+        return true;
+    }
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+    bool write(const sf::Uint8* pixels) {
+        if (format == StreamFormat::Rgba) {
+            return writeAll(fd, pixels, static_cast<size_t>(width) * height * 4);
+        }
+
+        size_t lumaBytes = static_cast<size_t>(width) * height;
+        size_t chromaBytes = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+        uint8_t* yPlane = frameBuffer.data() + 6;
+        convertRgbaToYuv420(pixels, width, height, yPlane, yPlane + lumaBytes, yPlane + lumaBytes + chromaBytes);
+        return writeAll(fd, frameBuffer.data(), frameBuffer.size());
+    }
+
+private:
+    int fd = -1;
+    StreamFormat format = StreamFormat::None;
+    int width = 0, height = 0;
+    std::vector<uint8_t> frameBuffer;
+};
+
+#ifndef _WIN32
+// Publishes frames to other local processes through a POSIX shared-memory ring, without copies or encoding.
+// Frames are rendered straight into the ring's slots. Layout of /NAME:
+//   SharedRingHeader, then slotCount SharedRingSlot headers, then at dataOffset slotCount RGBA frames
+//   of slotStride bytes each.
+// Frame n (counting from 0 in publish order) lives in slot n % slotCount. A slot's sequence is 2n+1 while
+// frame n is being rendered into it and 2n+2 once it is complete. The producer never waits for consumers.
+// To read the newest frame a consumer loads `published` (acquire); if it is k > 0, frame k-1 is in slot
+// (k-1) % slotCount. It loads that slot's sequence (acquire), expecting 2k; uses the pixels in place;
+// issues an acquire fence and reloads the sequence. If it is unchanged the pixels it read were intact,
+// otherwise the producer lapped it and it should retry with a newer frame.
+struct alignas(64) SharedRingHeader {
+    char magic[8];                 // "FRACRING"
+    uint32_t version;              // 1
+    uint32_t slotCount;
+    uint32_t width;
+    uint32_t height;
+    uint64_t slotStride;
+    uint64_t dataOffset;
+    std::atomic<uint64_t> published; // frames completed so far
+    std::atomic<uint32_t> closed;    // 1 once the producer has finished
+};
+
+struct alignas(64) SharedRingSlot {
+    std::atomic<uint64_t> sequence;
+    int32_t frameNumber;           // animation frame held by the slot
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared ring needs lock-free 64-bit atomics");
+
+class SharedFrameRing {
+public:
+    // Readers that still have the ring mapped keep it until they unmap; the name goes at once
+    ~SharedFrameRing() {
+        if (!header) return;
+        header->closed.store(1, std::memory_order_release);
+        munmap(header, mappedBytes);
+        shm_unlink(name.c_str());
+    }
+
+    bool open(const std::string& shmName, int slots, int frameWidth, int frameHeight) {
+        name = shmName[0] == '/' ? shmName : "/" + shmName;
+        slotCount = slots;
+        uint64_t slotStride = (static_cast<uint64_t>(frameWidth) * frameHeight * 4 + 4095) & ~static_cast<uint64_t>(4095);
+        uint64_t dataOffset = (sizeof(SharedRingHeader) + slots * sizeof(SharedRingSlot) + 4095) & ~static_cast<uint64_t>(4095);
+        mappedBytes = dataOffset + slotStride * slots;
+
+        // Never truncate an existing object: a reader may still have it mapped and would fault on the
+        // vanished pages. One left behind is marked closed, so its readers stop, and unlinked instead;
+        // it lives on for them while the new ring is a separate object.
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0 && errno == EEXIST) {
+            retireStale();
+            fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        }
+        if (fd < 0) return false;
+        bool sized = ftruncate(fd, static_cast<off_t>(mappedBytes)) == 0;
+        void* mapping = sized ? mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return false;
+        }
+
+        // A fresh shm object is zero-filled: every slot starts at sequence 0, i.e. never written
+        header = static_cast<SharedRingHeader*>(mapping);
+        slotHeaders = reinterpret_cast<SharedRingSlot*>(header + 1);
+        pixels = static_cast<uint8_t*>(mapping) + dataOffset;
+        header->version = 1;
+        header->slotCount = slots;
+        header->width = frameWidth;
+        header->height = frameHeight;
+        header->slotStride = slotStride;
+        header->dataOffset = dataOffset;
+        std::memcpy(header->magic, "FRACRING", 8);
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+    }
+
+    int slots() const {
+        return slotCount;
+    }
+
+    // Claim the next slot for a frame about to be rendered; frames must be published in the order they begin
+    sf::Uint8* beginFrame(int frameNumber) {
+        uint64_t n = begun++;
+        SharedRingSlot& slot = slotHeaders[n % slotCount];
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // readers of the old frame see the odd sequence first
+        slot.frameNumber = frameNumber;
+        return pixels + (n % slotCount) * header->slotStride;
+    }
+
+    // Mark the oldest begun frame complete
+    void publish() {
+        uint64_t n = header->published.load(std::memory_order_relaxed);
+        slotHeaders[n % slotCount].sequence.store(2 * n + 2, std::memory_order_release);
+        header->published.store(n + 1, std::memory_order_release);
+    }
+
+private:
+    void retireStale() {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd >= 0) {
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(SharedRingHeader))) {
+                void* mapping = mmap(nullptr, sizeof(SharedRingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (mapping != MAP_FAILED) {
+                    SharedRingHeader* stale = static_cast<SharedRingHeader*>(mapping);
+                    if (std::memcmp(stale->magic, "FRACRING", 8) == 0) stale->closed.store(1, std::memory_order_release);
+                    munmap(mapping, sizeof(SharedRingHeader));
+                }
+            }
+            close(fd);
+        }
+        shm_unlink(name.c_str());
     }
-};
 
-struct ReturnInfo {
-    int iteration;
-    double smoothIteration;
-    double stripeSum;
+    std::string name;
+    int slotCount = 0;
+    size_t mappedBytes = 0;
+    SharedRingHeader* header = nullptr;
+    SharedRingSlot* slotHeaders = nullptr;
+    uint8_t* pixels = nullptr;
+    uint64_t begun = 0;
 };
 
-// Forward declarations
-void renderFractalRegion(sf::Uint8* pixels, const RenderState& state, int startY, int endY, int width, int height);
-void saveScreenshot(const sf::Texture& texture, const RenderState& state);
-std::string getInfoString(const RenderState& state, double mouseX, double mouseY);
+// When set, runAnimation renders frames straight into this ring
+SharedFrameRing* frameRing = nullptr;
+#endif
 
-// Color palettes
-const std::vector<std::vector<sf::Color>> PALETTES = {
-    {
-        sf::Color(66, 30, 15), sf::Color(25, 7, 26), sf::Color(9, 1, 47),
-        sf::Color(4, 4, 73), sf::Color(0, 7, 100), sf::Color(12, 44, 138),
-        sf::Color(24, 82, 177), sf::Color(57, 125, 209), sf::Color(134, 181, 229),
-        sf::Color(211, 236, 248), sf::Color(241, 233, 191), sf::Color(248, 201, 95),
-        sf::Color(255, 170, 0), sf::Color(204, 128, 0), sf::Color(153, 87, 0),
-    },
-    {
-        sf::Color(0, 0, 0), sf::Color(255, 255, 255),
+// True if a frame's output is already on disk
+bool frameExists(int frameNumber) {
+    if (frameArchive) return frameArchive->contains(frameNumber);
+    char name[64];
+    formatFrameFileName(name, sizeof(name), frameNumber);
+#ifdef _WIN32
+    return _access(name, 4) == 0;
+#else
+    return access(name, R_OK) == 0;
+#endif
+}
+
+
+// Auto-adjust iterations based on zoom level
+void adjustIterations(RenderState& state) {
+    if (state.autoIterations) {
+        double zoomFactor = 3.0 / state.viewportHeight;
+        state.maxIterations = std::min(10000, static_cast<int>(100 * log10(1 + zoomFactor)));
+        state.maxIterations = std::max(100, state.maxIterations);
     }
+}
+
+// Command line / environment settings
+struct Options {
+    int threads = 0;        // 0 = detect
+    bool pinThreads = false;
+    bool skipSmt = false;
+    HugePages hugePages = HugePages::Off;
+    int benchmarkFrames = 0; // > 0 renders that many animation frames without a window and exits
+    int framesInFlight = 0;  // 0 = choose from the core count and frame size
+    int firstFrame = 0;      // animation frame range, inclusive
+    int lastFrame = INT_MAX;
+    bool overwrite = false;  // re-render frames that are already on disk
+    bool headless = false;   // render the animation to files without creating a window
+    int width = WINDOW_WIDTH; // output size for headless and benchmark runs
+    int height = WINDOW_HEIGHT;
+    int encoderThreads = 0;  // 0 = a quarter of the render threads, 1 to 4
+    int writeQueue = 4;      // frames that may wait for an encoder before rendering blocks
+    int pngLevel = 6;        // zlib level 0-9 for saved frames
+    FrameFormat format = FrameFormat::Png;
+    StreamFormat stream = StreamFormat::None; // stream frames to `output` instead of saving files
+    std::string output = "-";  // "-" = stdout, otherwise a file or named pipe
+    int fps = 30;
+    std::string archive;       // append frames to this single archive file instead of N.png files
+    int extractFrame = -1;     // >= 0: copy that frame out of the archive to its own file and exit
+    FileIo io = FileIo::Blocking;
+    bool directIo = false;
+    int ioBenchmarkFiles = 0;  // > 0 writes that many frame-sized files with each I/O path and exits
+    bool expMap = false;       // zoom frames warped from one log-polar strip instead of rendered one by one
+    bool keyframes = false;    // zoom frames resampled from keyframes rendered at every 2x of zoom
+    bool histogram = false;    // color the animation by histogram instead of its colorDensity fade
+    bool antiAliasing = false; // adaptive edge anti-aliasing for animation frames
+    bool frameCache = true;    // skip frames on disk only if their recorded RenderState hash still matches
+    std::string shm;           // publish frames to this POSIX shared-memory ring instead of saving them
+    int shmSlots = 4;
+    int supersample = 1;       // render animation frames at this multiple of the output size, then filter down
+    ResampleFilter filter = ResampleFilter::Box;
 };
 
-// Linear interpolation for colors
-inline sf::Color interpolateColors(const sf::Color& c1, const sf::Color& c2, double factor) {
-    return sf::Color(
-        static_cast<sf::Uint8>(c1.r + factor * (c2.r - c1.r)),
-        static_cast<sf::Uint8>(c1.g + factor * (c2.g - c1.g)),
-        static_cast<sf::Uint8>(c1.b + factor * (c2.b - c1.b))
-    );
+// "png", "qoi", "ppm", "pam" or "tga"
+FrameFormat parseFrameFormat(const std::string& name) {
+    if (name == "qoi") return FrameFormat::Qoi;
+    if (name == "ppm") return FrameFormat::Ppm;
+    if (name == "pam") return FrameFormat::Pam;
+    if (name == "tga") return FrameFormat::Tga;
+    if (name != "png") std::cerr << "Unknown frame format " << name << ", using png" << std::endl;
+    return FrameFormat::Png;
 }
 
-// Fast calculation of fractal iteration count with optimizations
-inline ReturnInfo calculateFractal(double cr, double ci, double jr, double ji, int maxIter, bool isJulia, int fractalType, bool stripes, float stripeFrequency, bool innerCalculation) {
-    // Set initial values based on fractal type
-    double zr = isJulia ? cr : 0;
-    double zi = isJulia ? ci : 0;
-    double cr_actual = isJulia ? jr : cr;
-    double ci_actual = isJulia ? ji : ci;
+// "off", "thp" or "explicit"
+HugePages parseHugePages(const std::string& mode) {
+    if (mode == "thp") return HugePages::Transparent;
+    if (mode == "explicit") return HugePages::Explicit;
+    return HugePages::Off;
+}
 
-    ReturnInfo iterationInfo;
+// Environment variables first, then command line flags on top
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    if (const char* env = std::getenv("FRACTAL_THREADS")) options.threads = std::atoi(env);
+    if (const char* env = std::getenv("FRACTAL_PIN")) options.pinThreads = std::atoi(env) != 0;
+    if (const char* env = std::getenv("FRACTAL_NO_SMT")) options.skipSmt = std::atoi(env) != 0;
+    if (const char* env = std::getenv("FRACTAL_HUGE_PAGES")) options.hugePages = parseHugePages(env);
+    if (const char* env = std::getenv("FRACTAL_FRAMES_IN_FLIGHT")) options.framesInFlight = std::atoi(env);
+    if (const char* env = std::getenv("FRACTAL_ENCODER_THREADS")) options.encoderThreads = std::atoi(env);
+    if (const char* env = std::getenv("FRACTAL_FORMAT")) options.format = parseFrameFormat(env);
+    if (const char* env = std::getenv("FRACTAL_IO")) options.io = std::string(env) == "uring" ? FileIo::Uring : FileIo::Blocking;
 
-    // Early bailout checks for Mandelbrot
-    if (!innerCalculation && !isJulia && fractalType == 0) {
-        // Cardioid check
-        double q = (cr - 0.25) * (cr - 0.25) + ci * ci;
-        if (q * (q + (cr - 0.25)) < 0.25 * ci * ci) {
-            iterationInfo.iteration = -1;
-            return iterationInfo;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::atoi(argv[++i]);
         }
-
-        // Period-2 bulb check
-        if ((cr + 1.0) * (cr + 1.0) + ci * ci < 0.0625) {
-            iterationInfo.iteration = -1;
-            return iterationInfo;
+        else if (arg == "--pin") {
+            options.pinThreads = true;
+        }
+        else if (arg == "--no-smt") {
+            options.skipSmt = true;
+        }
+        else if (arg == "--huge-pages" && i + 1 < argc) {
+            options.hugePages = parseHugePages(argv[++i]);
+        }
+        else if (arg == "--benchmark" && i + 1 < argc) {
+            options.benchmarkFrames = std::atoi(argv[++i]);
+        }
+        else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            options.framesInFlight = std::atoi(argv[++i]);
+        }
+        else if (arg == "--frames" && i + 1 < argc) {
+            // "A..B", "A.." or a single frame "A"
+            std::string range = argv[++i];
+            size_t dots = range.find("..");
+            options.firstFrame = std::max(0, std::atoi(range.c_str()));
+            if (dots == std::string::npos) options.lastFrame = options.firstFrame;
+            else if (dots + 2 < range.size()) options.lastFrame = std::atoi(range.c_str() + dots + 2);
+        }
+        else if (arg == "--overwrite") {
+            options.overwrite = true;
+        }
+        else if (arg == "--exp-map") {
+            options.expMap = true;
+        }
+        else if (arg == "--keyframes") {
+            options.keyframes = true;
+        }
+        else if (arg == "--histogram") {
+            options.histogram = true;
+        }
+        else if (arg == "--aa") {
+            options.antiAliasing = true;
+        }
+        else if (arg == "--no-frame-cache") {
+            options.frameCache = false;
+        }
+        else if (arg == "--encoder-threads" && i + 1 < argc) {
+            options.encoderThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--write-queue" && i + 1 < argc) {
+            options.writeQueue = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--format" && i + 1 < argc) {
+            options.format = parseFrameFormat(argv[++i]);
+        }
+        else if (arg == "--stream" && i + 1 < argc) {
+            std::string name = argv[++i];
+            options.stream = name == "y4m" ? StreamFormat::Y4m : name == "rgba" ? StreamFormat::Rgba : StreamFormat::None;
+            if (options.stream == StreamFormat::None) std::cerr << "Unknown stream format " << name << std::endl;
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        }
+        else if (arg == "--fps" && i + 1 < argc) {
+            options.fps = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--archive" && i + 1 < argc) {
+            options.archive = argv[++i];
+        }
+        else if (arg == "--extract-frame" && i + 1 < argc) {
+            options.extractFrame = std::atoi(argv[++i]);
+        }
+        else if (arg == "--io" && i + 1 < argc) {
+            // "uring" or "blocking"
+            options.io = std::string(argv[++i]) == "uring" ? FileIo::Uring : FileIo::Blocking;
+        }
+        else if (arg == "--direct-io") {
+            options.directIo = true;
+        }
+        else if (arg == "--io-benchmark" && i + 1 < argc) {
+            options.ioBenchmarkFiles = std::atoi(argv[++i]);
+        }
+        else if (arg == "--shm" && i + 1 < argc) {
+            options.shm = argv[++i];
+        }
+        else if (arg == "--shm-slots" && i + 1 < argc) {
+            options.shmSlots = std::max(2, std::atoi(argv[++i]));
+        }
+        else if (arg == "--png-level" && i + 1 < argc) {
+            options.pngLevel = std::max(0, std::min(9, std::atoi(argv[++i])));
+        }
+        else if (arg == "--supersample" && i + 1 < argc) {
+            options.supersample = std::max(1, std::min(SUPERSAMPLE_MAX, std::atoi(argv[++i])));
+        }
+        else if (arg == "--filter" && i + 1 < argc) {
+            // "box" or "lanczos"
+            std::string filter = argv[++i];
+            options.filter = filter == "lanczos" ? ResampleFilter::Lanczos : ResampleFilter::Box;
+            if (filter != "lanczos" && filter != "box") std::cerr << "Unknown filter " << filter << ", using box" << std::endl;
+        }
+        else if (arg == "--headless") {
+            options.headless = true;
+        }
+        else if (arg == "--size" && i + 1 < argc) {
+            // "WIDTHxHEIGHT"
+            std::string size = argv[++i];
+            size_t x = size.find('x');
+            if (x != std::string::npos) {
+                options.width = std::max(1, std::atoi(size.c_str()));
+                options.height = std::max(1, std::atoi(size.c_str() + x + 1));
+            }
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
         }
     }
+    return options;
+}
 
-    double zr2 = zr * zr;
-    double zi2 = zi * zi;
-    float stripeSum = 0;
-    int i = 0;
+// Pick the thread count and worker CPUs from the options and the container limits
+void configureThreads(const Options& options) {
+    std::vector<int> cpus = getAllowedCpus();
+    if (options.skipSmt) cpus = skipSmtSiblings(cpus);
 
-    // Main iteration loop (optimized)
-    while (zr2 + zi2 < ESCAPE_RADIUS_SQUARED) {
-        zi = (fractalType == 0) ? 2 * zr * zi : 2 * fabs(zr * zi);
-        zi += ci_actual;
-        zr = zr2 - zi2 + cr_actual;
-        zr2 = zr * zr;
-        zi2 = zi * zi;
-        if (stripes) stripeSum += powf(sin(atan2(zi, zr) * stripeFrequency), 2.0);
-        i++;
-        if (i == maxIter) {
-            if (innerCalculation) {
-                iterationInfo.iteration = i;
-                iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
-                iterationInfo.stripeSum = stripeSum;
-                return iterationInfo;
-            }
-            else {
-                iterationInfo.iteration = -1;
-                return iterationInfo;
+    NUM_THREADS = options.threads > 0 ? options.threads : detectThreadCount(cpus);
+    if (!options.pinThreads) return;
+    workerCpus = cpus;
+
+    // Map the pinned CPUs onto dense NUMA node indices
+    std::vector<int> cpuNodes = readCpuNodes();
+    std::vector<int> nodeIds;
+    for (int cpu : workerCpus) {
+        int node = cpu < static_cast<int>(cpuNodes.size()) ? std::max(0, cpuNodes[cpu]) : 0;
+        auto found = std::find(nodeIds.begin(), nodeIds.end(), node);
+        workerNodes.push_back(static_cast<int>(found - nodeIds.begin()));
+        if (found == nodeIds.end()) nodeIds.push_back(node);
+    }
+    numNodes = std::max<int>(1, nodeIds.size());
+}
+
+// Render animation frames back to back without a window and report the timings. Each frame is then
+// encoded in the selected format, untimed; debug builds check that rendering, shading and encoding the
+// timed frames make no heap allocations.
+void runBenchmark(const ZoomAnimation& animation, int frames, int width, int height) {
+    const size_t pixelBytes = static_cast<size_t>(width) * height * 4;
+    sf::Uint8* pixels = allocateLargeBuffer(pixelBytes);
+    firstTouchFrameBuffer(pixels, width, height);
+    std::vector<uint8_t> encoded;
+    encoded.reserve(pixelBytes * 2); // room for any frame in any format, incompressible ones included
+
+    // Warm up on the frame with the highest iteration limit, so buffers sized by it are already at their largest
+    int deepest = 0;
+    for (int i = 1; i < frames; i++) {
+        if (animation.stateAt(i).maxIterations > animation.stateAt(deepest).maxIterations) deepest = i;
+    }
+    RenderState warmup = animation.stateAt(deepest);
+    warmup.aspectRatio = static_cast<double>(width) / height;
+    renderFractal(pixels, warmup, width, height);
+    encodeFrame(pixels, width, height, encoded);
+
+    double totalMs = 0, bestMs = 1e30;
+#ifndef NDEBUG
+    const uint64_t warmAllocations = heapAllocations;
+#endif
+    for (int i = 0; i < frames; i++) {
+        RenderState state = animation.stateAt(i);
+        state.aspectRatio = static_cast<double>(width) / height;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        renderFractal(pixels, state, width, height);
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+        totalMs += ms;
+        bestMs = std::min(bestMs, ms);
+        encoded.clear();
+        encodeFrame(pixels, width, height, encoded);
+    }
+
+    std::cout << "Benchmark: " << frames << " frames, " << numNodes << " NUMA node(s), average "
+        << totalMs / frames << "ms, best " << bestMs << "ms" << std::endl;
+#ifndef NDEBUG
+    const uint64_t steadyAllocations = heapAllocations - warmAllocations;
+    std::cout << "Heap allocations while timed: " << steadyAllocations << std::endl;
+    assert(steadyAllocations == 0 && "rendering or encoding allocated once warm");
+#endif
+    freeLargeBuffer(pixels, pixelBytes);
+}
+
+// Write frame-sized files with blocking writes and through io_uring, and report the best throughput of each
+void runIoBenchmark(int files, int width, int height) {
+    std::vector<uint8_t> data(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+
+    // Each path writes one untimed file first (ring setup, first-touch of the staging buffers and
+    // the file system's metadata), then the rounds alternate the paths so neither always runs on a
+    // colder cache. Every file is fsynced, so the device is measured rather than page cache copies.
+    const FileIo paths[] = { FileIo::Blocking, FileIo::Uring };
+    const int rounds = 3;
+    double bestSeconds[2] = { 0, 0 };
+    bool ok[2] = { true, true };
+    bool uringActive = false;
+    for (int round = -1; round < rounds; round++) {
+        for (int p = 0; p < 2; p++) {
+            fileIo = paths[(p + std::max(round, 0)) % 2];
+            int index = fileIo == FileIo::Uring;
+#ifdef FRACTAL_IO_URING
+            if (fileIo == FileIo::Uring) uringActive = threadIoRing() != nullptr;
+#endif
+            int count = round < 0 ? 1 : files;
+            auto startTime = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < count; i++) {
+                ok[index] = writeFileBytes(("iobench." + std::to_string(i) + ".tmp").c_str(), data.data(), data.size(), true) && ok[index];
             }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < count; i++) std::remove(("iobench." + std::to_string(i) + ".tmp").c_str());
+
+            double seconds = std::chrono::duration<double>(endTime - startTime).count();
+            if (round >= 0 && (bestSeconds[index] == 0 || seconds < bestSeconds[index])) bestSeconds[index] = seconds;
         }
     }
 
-    // Smooth coloring formula
-    iterationInfo.iteration = i;
-    iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
-    iterationInfo.stripeSum = stripeSum;
-    return iterationInfo;
+    for (int index = 0; index < 2; index++) {
+        const char* label = index == 0 ? "blocking" : uringActive ? (directIo ? "io_uring (O_DIRECT)" : "io_uring")
+            : "blocking (io_uring unavailable)";
+        std::cout << label << ": " << files << " x " << data.size() / 1024 << " KiB, fsynced, best of " << rounds << ": "
+            << data.size() * files / (1024.0 * 1024.0) / bestSeconds[index] << " MiB/s"
+            << (ok[index] ? "" : " (write errors)") << std::endl;
+    }
 }
 
-// Calculate anti-aliased pixel color by sampling multiple points
-sf::Color calculateAntiAliasedColor(int x, int y, const RenderState& state, int width, int height, const std::vector<sf::Color>& palette) {
-    double pixelHeight = state.viewportHeight / height;
-    double pixelWidth = state.getViewportWidth() / width;
-    double halfHeight = state.viewportHeight / 2;
-    double halfWidth = state.getViewportWidth() / 2;
-
-    int samples = AA_MAX_SAMPLES + 1; // 1 = 2x2, 2 = 3x3, 3 = 4x4
+// Called in frame order with each finished frame (width x height RGBA); returns false to stop the animation
+typedef std::function<bool(const sf::Uint8* pixels, int frameNumber)> FramePresenter;
 
-    // Sample grid
-    std::vector<sf::Color> sampleColors;
-    sampleColors.reserve(samples * samples);
+// Play frames [firstFrame, lastFrame] of the animation with several frames in flight on the render pool.
+// Frames are displayed and saved strictly in order; frames already on disk are skipped unless overwriting.
+// With supersampling, frames render at a multiple of width x height and are filtered down once finished.
+void runAnimation(const ZoomAnimation& animation, const Options& options, int width, int height,
+    int framesInFlight, const FramePresenter& present) {
+    const int renderWidth = width * supersample, renderHeight = height * supersample;
+    const size_t pixelBytes = static_cast<size_t>(renderWidth) * renderHeight * 4;
+    const size_t outputBytes = static_cast<size_t>(width) * height * 4;
+#ifndef _WIN32
+    const bool ownBuffers = frameRing == nullptr;
+    if (frameRing) framesInFlight = std::min(framesInFlight, frameRing->slots() - 1); // keep the newest frame readable
+#else
+    const bool ownBuffers = true;
+#endif
+    std::cout << "Animating with " << framesInFlight << " frame(s) in flight" << std::endl;
 
-    for (int sy = 0; sy < samples; sy++) {
-        for (int sx = 0; sx < samples; sx++) {
-            // Calculate subpixel position
-            double offsetX = (sx + 0.5) / samples;
-            double offsetY = (sy + 0.5) / samples;
+    // A frame on disk is reused only if the frame cache (when there is one) says it came from the same state
+    auto upToDate = [&](int frameNumber) {
+        if (options.overwrite || !frameExists(frameNumber)) return false;
+        if (!frameCache) return true;
+        RenderState state = animation.stateAt(frameNumber);
+        state.aspectRatio = static_cast<double>(width) / height;
+        return frameCache->matches(frameNumber, hashFrame(state, width, height));
+    };
 
-            double cr = state.viewportX - halfWidth + (x + offsetX) * pixelWidth;
-            double ci = state.viewportY - halfHeight + (y + offsetY) * pixelHeight;
+    int nextFrame = options.firstFrame;
+    auto takeNextFrame = [&]() {
+        while (nextFrame <= options.lastFrame && upToDate(nextFrame)) {
+            nextFrame++;
+        }
+        return nextFrame <= options.lastFrame ? nextFrame++ : -1;
+    };
 
-            // Calculate iterations for this sample
-            ReturnInfo info = calculateFractal(cr, ci, state.juliaX, state.juliaY,
-                state.maxIterations, state.showJulia, state.fractalType, state.stripes,
-                state.stripeFrequency, state.innerCalculation);
+    // Slots are filled in frame order, so the oldest frame in flight is always the next slot
+    const size_t resultBytes = resultBufferBytes(renderWidth, renderHeight);
+    std::vector<FrameInFlight> frames(framesInFlight);
+    std::vector<int> frameNumbers(framesInFlight, -1);
+    std::vector<ResultCell*> slotResults(framesInFlight, nullptr); // allocated once a slot needs them
 
-            sf::Color color;
-            if (info.iteration == -1) {
-                color = sf::Color(0, 0, 0);
-            }
-            else {
-                float iterations;
-                if (state.stripes) {
-                    iterations = state.stripeIntensity * (info.stripeSum / info.iteration);
-                }
-                else {
-                    iterations = info.smoothIteration * state.colorDensity;
-                }
-                int index = static_cast<int>(iterations) % palette.size();
-                double fract = iterations - std::floor(iterations);
-                color = interpolateColors(palette[index], palette[(index + 1) % palette.size()], fract);
-            }
+    // With a shared ring each frame renders into the ring slot it will be published from.
+    // A frame that only changes the coloring of the one before it (a colorDensity fade on a still view)
+    // is shaded from that frame's results; it waits for them, and finishes at once so they can be reused.
+    // Results are only kept where they are used: by histogram coloring, and by a frame the next one
+    // re-colors, which only happens once the view has come to rest.
+    FrameInFlight* previous = nullptr;
+    auto startFrame = [&](int slot, int frameNumber) {
+        FrameInFlight& frameJob = frames[slot];
+#ifndef _WIN32
+        if (frameRing) frameJob.output = frameRing->beginFrame(frameNumber);
+        if (frameRing && supersample == 1) frameJob.pixels = frameJob.output;
+#endif
+        RenderState state = animation.stateAt(frameNumber);
+        state.aspectRatio = static_cast<double>(width) / height;
+        bool recolor = previous && previous->hasResults && sameIterations(previous->state, state);
+        RenderState next = animation.stateAt(frameNumber + 1);
+        next.aspectRatio = state.aspectRatio;
+        if (recolor || equalizedColors(state) || sameIterations(state, next)) {
+            if (!slotResults[slot]) slotResults[slot] = reinterpret_cast<ResultCell*>(allocateLargeBuffer(resultBytes));
+            frameJob.results = slotResults[slot];
+        }
+        else {
+            frameJob.results = nullptr;
+        }
+        frameJob.state = state;
+        if (frameCache) frameCache->expect(frameNumber, hashFrame(frameJob.state, width, height));
+        if (recolor) {
+            renderPool.wait(previous->job);
+            if (equalizedColors(state) && previous->levels.empty()) equalizeColors(*previous);
+            submitShading(frameJob, *previous);
+            renderPool.wait(frameJob.job);
+        }
+        else if (expMapRenderer && expMapRenderer->covers(frameJob.state)) expMapRenderer->submitFrame(frameJob);
+        else if (keyframeRenderer && keyframeRenderer->covers(frameJob.state)) keyframeRenderer->submitFrame(frameJob);
+        else submitFrame(frameJob);
+        previous = &frameJob;
+    };
 
-            sampleColors.push_back(color);
+    for (int slot = 0; slot < framesInFlight; slot++) {
+        FrameInFlight& frameJob = frames[slot];
+        frameJob.width = renderWidth;
+        frameJob.height = renderHeight;
+        if (ownBuffers || supersample > 1) {
+            frameJob.pixels = allocateLargeBuffer(pixelBytes);
+            firstTouchFrameBuffer(frameJob.pixels, renderWidth, renderHeight);
         }
+        if (ownBuffers) frameJob.output = supersample > 1 ? allocateLargeBuffer(outputBytes) : frameJob.pixels;
+
+        frameNumbers[slot] = takeNextFrame();
+        if (frameNumbers[slot] >= 0) startFrame(slot, frameNumbers[slot]);
     }
 
-    // Average the samples
-    int totalR = 0, totalG = 0, totalB = 0;
-    for (const auto& color : sampleColors) {
-        totalR += color.r;
-        totalG += color.g;
-        totalB += color.b;
+    for (int slot = 0; frameNumbers[slot] >= 0; slot = (slot + 1) % framesInFlight) {
+        FrameInFlight& current = frames[slot];
+        finishFrame(current);
+        if (supersample > 1) resolveFrame(current);
+        if (!present(current.output, frameNumbers[slot])) break;
+
+        // Reuse the slot for the next frame after the ones already in flight
+        frameNumbers[slot] = takeNextFrame();
+        if (frameNumbers[slot] >= 0) startFrame(slot, frameNumbers[slot]);
     }
 
-    int sampleCount = sampleColors.size();
-    return sf::Color(
-        static_cast<sf::Uint8>(totalR / sampleCount),
-        static_cast<sf::Uint8>(totalG / sampleCount),
-        static_cast<sf::Uint8>(totalB / sampleCount)
-    );
+    for (int slot = 0; slot < framesInFlight; slot++) {
+        FrameInFlight& frameJob = frames[slot];
+        renderPool.wait(frameJob.job);
+        if (ownBuffers || supersample > 1) freeLargeBuffer(frameJob.pixels, pixelBytes);
+        if (ownBuffers && supersample > 1) freeLargeBuffer(frameJob.output, outputBytes);
+        if (slotResults[slot]) freeLargeBuffer(reinterpret_cast<sf::Uint8*>(slotResults[slot]), resultBytes);
+    }
 }
 
-// Render the fractal using multiple threads
-void renderFractal(sf::Uint8* pixels, const RenderState& state, int width, int height, bool usePreview = false) {
-    std::vector<std::thread> threads;
-    int linesPerThread = height / NUM_THREADS;
-
-    for (int i = 0; i < NUM_THREADS; i++) {
-        int startY = i * linesPerThread;
-        int endY = (i == NUM_THREADS - 1) ? height : (i + 1) * linesPerThread;
-        threads.emplace_back(renderFractalRegion, pixels, std::ref(state), startY, endY, width, height);
+int main(int argc, char** argv) {
+    Options options = parseOptions(argc, argv);
+    if (options.keyframes && options.expMap) {
+        std::cerr << "--keyframes and --exp-map are exclusive" << std::endl;
+        return 1;
     }
 
-    for (auto& thread : threads) {
-        thread.join();
+    // Frames own stdout when streaming to it; log to stderr instead
+    if (options.stream != StreamFormat::None && options.output == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
     }
-}
 
-// Render a region of the fractal (for multi-threading)
-void renderFractalRegion(sf::Uint8* pixels, const RenderState& state, int startY, int endY, int width, int height) {
-    double pixelHeight = state.viewportHeight / height;
-    double pixelWidth = state.getViewportWidth() / width;
-    double halfHeight = state.viewportHeight / 2;
-    double halfWidth = state.getViewportWidth() / 2;
-    const auto& palette = PALETTES[state.colorScheme % PALETTES.size()];
+    configureThreads(options);
+    hugePageMode = options.hugePages;
+    pngLevel = options.pngLevel;
+    frameFormat = options.format;
+    supersample = options.supersample;
+    resampleFilter = options.filter;
 
-    for (int y = startY; y < endY; y++) {
-        for (int x = 0; x < width; x++) {
-            sf::Color color;
+    // Random-access read of a single frame from an archive
+    if (options.extractFrame >= 0) {
+        std::vector<uint8_t> data;
+        if (options.archive.empty() || !FrameArchive::readFrame(options.archive, options.extractFrame, data, frameFormat)) {
+            std::cerr << "Frame " << options.extractFrame << " not found in archive " << options.archive << std::endl;
+            return 1;
+        }
+        std::string filename = frameFileName(options.extractFrame);
+        if (!writeFileBytes(filename.c_str(), data.data(), data.size())) return 1;
+        std::cout << "Extracted " << filename << std::endl;
+        return 0;
+    }
 
-            // Use anti-aliasing if enabled
-            if (state.antiAliasing) {
-                color = calculateAntiAliasedColor(x, y, state, width, height, palette);
-            }
-            else {
-                // Standard single-sample rendering
-                double cr = state.viewportX - halfWidth + x * pixelWidth;
-                double ci = state.viewportY - halfHeight + y * pixelHeight;
+    fileIo = options.io;
+    directIo = options.directIo;
+    if (options.ioBenchmarkFiles > 0) {
+        runIoBenchmark(options.ioBenchmarkFiles, options.width, options.height);
+        return 0;
+    }
 
-                // Calculate iterations
-                ReturnInfo info = calculateFractal(cr, ci, state.juliaX, state.juliaY,
-                    state.maxIterations, state.showJulia, state.fractalType, state.stripes, state.stripeFrequency, state.innerCalculation);
+    std::cout << "Starting Fractal Explorer with " << NUM_THREADS << " threads" << std::endl;
 
-                if (info.iteration == -1) {
-                    color = sf::Color(0, 0, 0);
-                }
-                else {
-                    float iterations;
-                    if (state.stripes) {
-                        iterations = state.stripeIntensity * (info.stripeSum / info.iteration);
-                    }
-                    else {
-                        iterations = info.smoothIteration * state.colorDensity;
-                    }
-                    int index = static_cast<int>(iterations) % palette.size();
-                    double fract = iterations - std::floor(iterations);
-                    color = interpolateColors(palette[index], palette[(index + 1) % palette.size()], fract);
-                }
-            }
+    ZoomAnimation animation;
+    adjustIterations(animation.start);
+    animation.start.histogramColoring = options.histogram;
+    animation.start.antiAliasing = options.antiAliasing;
+    int encoderThreads = options.encoderThreads > 0 ? options.encoderThreads : std::max(1, std::min(4, NUM_THREADS / 4));
 
-            int pixelIndex = (y * width + x) * 4;
-            pixels[pixelIndex] = color.r;
-            pixels[pixelIndex + 1] = color.g;
-            pixels[pixelIndex + 2] = color.b;
-            pixels[pixelIndex + 3] = 255;
+    // One archive for the whole run; reopening it resumes after the frames it already holds
+    FrameArchive archive;
+    if (!options.archive.empty() && options.stream == StreamFormat::None) {
+        if (!archive.open(options.archive, frameFormat)) {
+            std::cerr << "Failed to open archive " << options.archive << std::endl;
+            return 1;
         }
+        frameArchive = &archive;
     }
-}
 
-// Save screenshot with location info in filename
-void saveScreenshot(const sf::Texture& texture, const RenderState& state) {
-    sf::Image screenshot = texture.copyToImage();
+    // Frame hashes live next to the output: beside the archive, or in the frame directory
+    FrameCache cache;
+    if (options.frameCache && options.stream == StreamFormat::None && options.shm.empty()) {
+        std::string indexPath = options.archive.empty() ? "frames.hashes" : options.archive + ".hashes";
+        if (cache.open(indexPath)) frameCache = &cache;
+        else std::cerr << "Failed to open frame cache " << indexPath << ", resuming by file existence" << std::endl;
+    }
 
-    time_t now = time(0);
-    tm timeinfo;
+    // Streams carry every frame of the range in order; there are no files to resume from
+    FrameStream stream;
+    if (options.stream != StreamFormat::None) {
+        int streamWidth = options.headless ? options.width : WINDOW_WIDTH;
+        int streamHeight = options.headless ? options.height : WINDOW_HEIGHT;
+        if (!stream.open(options.output, options.stream, streamWidth, streamHeight, options.fps)) {
+            std::cerr << "Failed to open stream output " << options.output << std::endl;
+            return 1;
+        }
+        options.overwrite = true;
+    }
 
-#ifdef _WIN32
-    localtime_s(&timeinfo, &now);
+#ifndef _WIN32
+    // Consumers read frames from the ring; nothing is written to disk
+    SharedFrameRing ring;
+    if (!options.shm.empty()) {
+        int ringWidth = options.headless ? options.width : WINDOW_WIDTH;
+        int ringHeight = options.headless ? options.height : WINDOW_HEIGHT;
+        if (!ring.open(options.shm, options.shmSlots, ringWidth, ringHeight)) {
+            std::cerr << "Failed to create shared memory ring " << options.shm << std::endl;
+            return 1;
+        }
+        frameRing = &ring;
+        options.overwrite = true;
+    }
 #else
-    tm* temp = localtime(&now);
-    if (temp) timeinfo = *temp;
+    if (!options.shm.empty()) std::cerr << "Shared memory export is not supported on Windows" << std::endl;
 #endif
 
-    std::stringstream filename;
-    filename << frame << ".png";
-
-    screenshot.saveToFile(filename.str());
-    std::cout << "Screenshot saved: " << filename.str() << std::endl;
-}
-
+    // Frames zooming into the animation's target come from one log-polar strip, or from keyframes
+    // (neither can serve antialiased, inner-colored or histogram-colored frames; those render directly)
+    ExpMapRenderer expMap;
+    if (options.expMap) {
+        if (expMap.configure(animation, options.lastFrame, (options.headless ? options.width : WINDOW_WIDTH) * supersample,
+            (options.headless ? options.height : WINDOW_HEIGHT) * supersample)) {
+            expMapRenderer = &expMap;
+        }
+        else std::cerr << "--exp-map: no frame zooms around the target in a way it can reproduce, rendering directly" << std::endl;
+    }
+    KeyframeRenderer keyframes;
+    if (options.keyframes) {
+        if (keyframes.configure(animation, options.lastFrame, (options.headless ? options.width : WINDOW_WIDTH) * supersample,
+            (options.headless ? options.height : WINDOW_HEIGHT) * supersample)) {
+            keyframeRenderer = &keyframes;
+        }
+        else std::cerr << "--keyframes: no frame zooms around the target in a way they can reproduce, rendering directly" << std::endl;
+    }
 
-// Auto-adjust iterations based on zoom level
-void adjustIterations(RenderState& state) {
-    if (state.autoIterations) {
-        double zoomFactor = 3.0 / state.viewportHeight;
-        state.maxIterations = std::min(10000, static_cast<int>(100 * log10(1 + zoomFactor)));
-        state.maxIterations = std::max(100, state.maxIterations);
+    if (options.benchmarkFrames > 0) {
+        runBenchmark(animation, options.benchmarkFrames, options.width, options.height);
+        return 0;
     }
-}
 
-int main() {
-    std::cout << "Starting Fractal Explorer with " << NUM_THREADS << " threads" << std::endl;
+    // Offline batch render: frames go from the CPU buffer straight to disk, no window and no frame cap
+    if (options.headless) {
+        int framesInFlight = options.framesInFlight > 0 ? options.framesInFlight : chooseFramesInFlight(options.width * supersample, options.height * supersample);
+        FrameWriter writer(encoderThreads, options.writeQueue);
+        runAnimation(animation, options, options.width, options.height, framesInFlight,
+            [&](const sf::Uint8* pixels, int frameNumber) {
+#ifndef _WIN32
+                if (frameRing) {
+                    frameRing->publish();
+                    return true;
+                }
+#endif
+                if (stream.isOpen()) return stream.write(pixels);
+                writer.write(pixels, options.width, options.height, frameNumber);
+                return true;
+            });
+        writer.flush();
+        return archive.close() ? 0 : 1;
+    }
 
     // Create window and rendering resources
     sf::RenderWindow window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), WINDOW_TITLE);
@@ -324,7 +4360,44 @@ int main() {
     }
 
     sf::Sprite sprite(texture);
-    sf::Uint8* pixels = new sf::Uint8[WINDOW_WIDTH * WINDOW_HEIGHT * 4];
+
+    if (animating) {
+        int framesInFlight = options.framesInFlight > 0 ? options.framesInFlight : chooseFramesInFlight(WINDOW_WIDTH * supersample, WINDOW_HEIGHT * supersample);
+        FrameWriter writer(encoderThreads, options.writeQueue);
+        runAnimation(animation, options, WINDOW_WIDTH, WINDOW_HEIGHT, framesInFlight,
+            [&](const sf::Uint8* pixels, int frameNumber) {
+                sf::Event event;
+                while (window.pollEvent(event)) {
+                    if (event.type == sf::Event::Closed)
+                        window.close();
+                }
+
+                texture.update(pixels);
+                window.clear();
+                window.draw(sprite);
+                window.display();
+#ifndef _WIN32
+                if (frameRing) {
+                    frameRing->publish();
+                    return window.isOpen();
+                }
+#endif
+                if (stream.isOpen()) return stream.write(pixels) && window.isOpen();
+                writer.write(pixels, WINDOW_WIDTH, WINDOW_HEIGHT, frameNumber);
+                return window.isOpen();
+            });
+        writer.flush();
+        return archive.close() ? 0 : 1;
+    }
+
+    // Allocate the frame untouched and let the render threads fault it in on their own nodes
+    const size_t pixelBytes = static_cast<size_t>(WINDOW_WIDTH) * WINDOW_HEIGHT * 4;
+    sf::Uint8* pixels = allocateLargeBuffer(pixelBytes);
+    firstTouchFrameBuffer(pixels, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Iteration results of the displayed frame, so coloring-only changes just re-shade it
+    const size_t resultBytes = resultBufferBytes(WINDOW_WIDTH, WINDOW_HEIGHT);
+    ResultCell* results = reinterpret_cast<ResultCell*>(allocateLargeBuffer(resultBytes));
 
     // Load font for text display
     sf::Font font;
@@ -345,7 +4418,8 @@ int main() {
     adjustIterations(state);
 
     auto startTime = std::chrono::high_resolution_clock::now();
-    renderFractal(pixels, state, WINDOW_WIDTH, WINDOW_HEIGHT);
+    renderFractal(pixels, state, WINDOW_WIDTH, WINDOW_HEIGHT, false, results);
+    RenderState renderedState = state;
     auto endTime = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
 
@@ -355,7 +4429,8 @@ int main() {
     // Tracking variables
     sf::Vector2i lastMousePos;
     bool isDragging = false;
-    std::string renderTimeStr = "Render time: " + std::to_string(duration) + "ms";
+    char renderTimeStr[64]; // formatted in place, no string built per frame
+    std::snprintf(renderTimeStr, sizeof(renderTimeStr), "Render time: %lldms", static_cast<long long>(duration));
     sf::Vector2i currentMousePos;
     double mouseComplexX = 0, mouseComplexY = 0;
 
@@ -364,6 +4439,9 @@ int main() {
     sf::Clock scrollTimer;
     bool pendingHighQualityRender = false;
 
+    // With anti-aliasing on, frames are rendered with one sample and refined while the window is idle
+    ProgressiveAA progressiveAA;
+
     // Main loop
     while (window.isOpen()) {
         sf::Event event;
@@ -374,11 +4452,6 @@ int main() {
             if (event.type == sf::Event::Closed)
                 window.close();
 
-            if (animating) {
-
-                break;
-            }
-
             if (event.type == sf::Event::MouseWheelScrolled) {
                 sf::Vector2i mousePos = sf::Mouse::getPosition(window);
 
@@ -499,7 +4572,10 @@ int main() {
                 case sf::Keyboard::F: // Toggle anti-aliasing
                     state.antiAliasing = !state.antiAliasing;
                     needsRedraw = true;
-                    pendingHighQualityRender = true;
+                    break;
+                case sf::Keyboard::H: // Toggle histogram coloring
+                    state.histogramColoring = !state.histogramColoring;
+                    needsRedraw = true;
                     break;
                 case sf::Keyboard::N: // Toggle inner calculation
                     state.innerCalculation = !state.innerCalculation;
@@ -537,45 +4613,65 @@ int main() {
             viewChanged = false;
         }
 
+        // Any change stops the refinement before the frame is drawn over
+        RenderState frameState = state;
+        frameState.antiAliasing = false;
+        bool frameRendered = pendingHighQualityRender || needsRedraw;
+        if (frameRendered) progressiveAA.cancel();
+
         // Perform high-quality render if needed
         if (pendingHighQualityRender) {
             startTime = std::chrono::high_resolution_clock::now();
-            renderFractal(pixels, state, WINDOW_WIDTH, WINDOW_HEIGHT, false);
+            renderFractal(pixels, frameState, WINDOW_WIDTH, WINDOW_HEIGHT, false, results);
+            renderedState = frameState;
             endTime = std::chrono::high_resolution_clock::now();
             duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
-            renderTimeStr = "Render time: " + std::to_string(duration) + "ms";
+            std::snprintf(renderTimeStr, sizeof(renderTimeStr), "Render time: %lldms", static_cast<long long>(duration));
             texture.update(pixels);
             pendingHighQualityRender = false;
         }
+        else if (needsRedraw && sameIterations(frameState, renderedState)) {
+            // Only the coloring changed (C, H, F, Up/Down): re-shade the kept results
+            startTime = std::chrono::high_resolution_clock::now();
+            reshadeFractal(pixels, results, frameState, WINDOW_WIDTH, WINDOW_HEIGHT);
+            renderedState = frameState;
+            endTime = std::chrono::high_resolution_clock::now();
+            duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+            std::snprintf(renderTimeStr, sizeof(renderTimeStr), "Shade time: %lldms", static_cast<long long>(duration));
+            texture.update(pixels);
+        }
         else if (needsRedraw) {
             // Use low-quality preview for interactive movements
             startTime = std::chrono::high_resolution_clock::now();
-            renderFractal(pixels, state, WINDOW_WIDTH, WINDOW_HEIGHT, usePreview);
+            renderFractal(pixels, frameState, WINDOW_WIDTH, WINDOW_HEIGHT, usePreview, results);
+            renderedState = frameState;
             endTime = std::chrono::high_resolution_clock::now();
             duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
-            renderTimeStr = usePreview ? "Preview time: " + std::to_string(duration) + "ms"
-                : "Render time: " + std::to_string(duration) + "ms";
+            std::snprintf(renderTimeStr, sizeof(renderTimeStr), "%s time: %lldms", usePreview ? "Preview" : "Render",
+                static_cast<long long>(duration));
+            texture.update(pixels);
+        }
+
+        // Refine a settled view, showing every finished pass
+        if (frameRendered && state.antiAliasing && !viewChanged && !isDragging) {
+            progressiveAA.start(pixels, results, frameState, WINDOW_WIDTH, WINDOW_HEIGHT);
+        }
+        if (progressiveAA.update()) {
+            std::snprintf(renderTimeStr, sizeof(renderTimeStr), "Anti-aliasing: %d samples", progressiveAA.sampleCount());
             texture.update(pixels);
+            progressiveAA.refine();
         }
 
         // Draw everything
         window.clear();
         window.draw(sprite);
         window.display();
-        if (animating) {
-            saveScreenshot(texture, state);
-            viewChanged = true;
-            state.viewportX += (-1.7110287606470104826428269 - state.viewportX) / 1;
-            state.viewportY += (0.0003109297379698081368812 - state.viewportY) / 1;
-            state.viewportHeight += (0.0000000000001705302565824 - state.viewportHeight) / 25;
-            state.colorDensity += (0.0186927672475576400756836 - state.colorDensity) / 25;
-            state.maxIterations += (1941 - state.maxIterations) / 25;
-            frame++;
-        }
     }
 
     // Clean up
-    delete[] pixels;
+    progressiveAA.cancel();
+    freeLargeBuffer(pixels, pixelBytes);
+    freeLargeBuffer(reinterpret_cast<sf::Uint8*>(results), resultBytes);
 
-    return 0;
+    return archive.close() ? 0 : 1;
 }